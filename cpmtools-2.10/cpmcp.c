@@ -158,13 +158,16 @@ static void usage(void)
   " -v    Report build version.\n");
 #if HAVE_LIBDSK_H
   fprintf(stderr,
-  " -T    libdsk type.\n"
+  " -T    libdsk type, or mem to work on a raw image in memory.\n"
   " -L x  LibDsk options (x) separated by spaces in double quotes\n"
   "             hd : data rate for 1.4Mb 3.5\" in 3.5\" drive.\n"
   "             dd : data rate for 360k 5.25\" in 1.2Mb drive.\n"
   "             sd : data rate for 720k 3.5\" in 3.5\" drive.\n"
   "             ed : data rate for 2.8Mb 3.5\" in 3.5\" drive.\n"
   "          dstep : double step (40T disk in 80T drive)\n");
+#else
+  fprintf(stderr,
+  " -T    mem to work on a raw image in memory.\n");
 #endif
   exit(1);
 }
@@ -386,6 +389,12 @@ int main(int argc, char *argv[])
           char buf[4096+1];
 
           cpmOpen(&ino,&file,O_WRONLY);
+          /* let the allocator reserve a contiguous run for the whole file */
+          {
+            struct stat statbuf;
+
+            if (fstat(fileno(ufp),&statbuf)==0) file.sizehint=statbuf.st_size;
+          }
           do
           {
             int j;
@@ -417,11 +426,18 @@ int main(int argc, char *argv[])
     }
   }
 
-  cpmUmount(&super);
+ if (cpmUmount(&super)==-1)
+ {
+    fprintf(stderr,"%s: can not write %s: %s\n",cmd,image,boo);
+    exitcode=1;
+ }
 
  /* 2015/04/26 uBee - Device_close() call missing causing IMD images to not be flushed */
- if (&super.dev)
-    Device_close(&super.dev);
+ if ((err=Device_close(&super.dev)))
+ {
+    fprintf(stderr,"%s: can not close %s: %s\n",cmd,image,err);
+    exitcode=1;
+ }
  
  exit(exitcode);
 }
@@ -11,6 +11,8 @@
 
 #include "cpmdir.h"
 #include "cpmfs.h"
+#include "trackcache.h"
+#include "device_mem.h"
 
 #ifdef USE_DMALLOC
 #include <dmalloc.h>
@@ -287,33 +289,101 @@ static void alvInit(const struct cpmSuperBlock *d)
 }
 
 /*============================================================================*/
-/* allocBlock         -- allocate a new disk block               */
+/* alvCtz / alvPopcount -- bit scans on one allocation vector word */
+/*============================================================================*/
+#if defined(__GNUC__)
+#define alvCtz(bits)      __builtin_ctz(bits)
+#define alvPopcount(bits) __builtin_popcount(bits)
+#else
+static int alvCtz(unsigned int bits)
+{
+  int n=0;
+
+  while (!(bits&1)) { bits>>=1; ++n; }
+  return n;
+}
+
+static int alvPopcount(unsigned int bits)
+{
+  int n=0;
+
+  while (bits) { bits&=bits-1; ++n; }
+  return n;
+}
+#endif
+
+/*============================================================================*/
+/* alvScan            -- find the first free (or used) block at or after     */
+/*                       'block', returns d->size if there is none           */
+/*============================================================================*/
+static int alvScan(const struct cpmSuperBlock *d, int block, int used)
+{
+  int i;
+  unsigned int bits;
+
+  if (block>=d->size) return d->size;
+  i=block/INTBITS;
+  bits=(used ? (unsigned int)d->alv[i] : ~(unsigned int)d->alv[i]) & (~0u<<(block%INTBITS));
+  while (bits==0)
+  {
+    if (++i>=d->alvSize) return d->size;
+    bits=used ? (unsigned int)d->alv[i] : ~(unsigned int)d->alv[i];
+  }
+  block=i*INTBITS+alvCtz(bits);
+  return block<d->size ? block : d->size;
+}
+
+/*============================================================================*/
+/* alvFindRun         -- find the first run of at least 'want' free blocks   */
+/*                       starting in [from,to), returns -1 if there is none  */
 /*============================================================================*/
-static int allocBlock(const struct cpmSuperBlock *drive)
+static int alvFindRun(const struct cpmSuperBlock *d, int from, int to, int want)
 {
-  int i,j,bits,block;
+  int start,end;
+
+  for (start=alvScan(d,from,0); start<to; start=alvScan(d,end,0))
+  {
+    end=alvScan(d,start,1);
+    if (end-start>=want) return start;
+  }
+  return -1;
+}
+
+/*============================================================================*/
+/* allocBlock         -- allocate a new disk block               */
+/*                                                               */
+/* 'prev' is the block written before this one in the file (or -1) and    */
+/* 'want' the number of blocks the file is expected to need from here.    */
+/* The block after 'prev' is used if it is free so files stay contiguous, */
+/* otherwise a free run of 'want' blocks is looked for starting at the    */
+/* next-fit cursor, and failing that the first free block after it.       */
+/*============================================================================*/
+static int allocBlock(struct cpmSuperBlock *drive, int prev, int want)
+{
+  int block;
 
   assert(drive!=(const struct cpmSuperBlock*)0);
-  for (i=0; i<drive->alvSize; ++i)
+  if (drive->alvNext>=drive->size) drive->alvNext=0;
+  if (prev>0 && prev+1<drive->size && alvScan(drive,prev+1,0)==prev+1) block=prev+1;
+  else
   {
-    for (j=0,bits=drive->alv[i]; j<INTBITS; ++j)
+    block=-1;
+    if (want>1)
     {
-      if ((bits&1)==0)
-      {
-        block=i*INTBITS+j;
-        if (block>=drive->size)
-        {
-          boo="device full";
-          return -1;
-        }
-        drive->alv[i] |= (1<<j);
-        return block;
-      }
-      bits >>= 1;
+      if ((block=alvFindRun(drive,drive->alvNext,drive->size,want))==-1)
+         block=alvFindRun(drive,0,drive->alvNext,want);
     }
+    if (block==-1 && (block=alvScan(drive,drive->alvNext,0))==drive->size)
+       block=alvScan(drive,0,0);
   }
-  boo="device full";
-  return -1;
+  if (block>=drive->size)
+  {
+    boo="device full";
+    return -1;
+  }
+  drive->alv[block/INTBITS] |= (1<<(block%INTBITS));
+  drive->alvNext=block+1;
+  return block;
 }
 
 /*
@@ -418,7 +488,7 @@ static int readBlock(const struct cpmSuperBlock *d, int blockno, char *buffer,
 
      /*    if (counter>=start && (err=Device_readSector(&d->dev,track,d->skewtab[sect],buffer+(d->secLength*counter)))) */
      /* uBee 2010/02/27 - Need to also pass the logical sector number to make 'remote' work on CP/M 3. */
-     if (counter>=start && (err=Device_readSector(&d->dev,track,d->skewtab[sect],sect,0,buffer+(d->secLength*counter))))
+     if (counter>=start && (err=Cache_readSector(&d->dev,track,d->skewtab[sect],sect,0,buffer+(d->secLength*counter))))
         {
          boo = err;
          return -1;
@@ -475,7 +545,7 @@ static int writeBlock(const struct cpmSuperBlock *d, int blockno, const char *bu
 
       /*    if (counter>=start && (err=Device_writeSector(&d->dev,track,d->skewtab[sect],buffer+(d->secLength*counter)))) */
       /* uBee 2010/02/27 - Need to also pass the logical sector number to make 'remote' work under CP/M 3 and AUXD. */
-      if (counter>=start && (err=Device_writeSector(&d->dev,track,d->skewtab[sect],sect,0,buffer+(d->secLength*counter))))    
+      if (counter>=start && (err=Cache_writeSector(&d->dev,track,d->skewtab[sect],sect,0,buffer+(d->secLength*counter))))    
          {
           boo = err;
           return -1;
@@ -528,18 +598,146 @@ static int writePhysDirectory(const struct cpmSuperBlock *drive)
 */
 
 /*============================================================================*/
-/* findFileExtent     -- find first/next extent for a file       */
+/* extent index */
+/* The in-core directory is indexed by file so that finding the extents of a */
+/* file does not need a scan of all maxdir entries.  Each file is hashed on  */
+/* (user, name, ext) and its extents are kept in a list sorted by extent     */
+/* number and then by directory position.  The list head is the file's       */
+/* lowest extent and is the entry that is linked into the hash bucket.       */
+/*============================================================================*/
+
+/* isFileExtent       -- is the entry in use by a file?          */
+static int isFileExtent(const struct cpmSuperBlock *sb, int entry)
+{
+  return ((unsigned char)sb->dir[entry].status) <= (sb->type==CPMFS_P2DOS ? 31 : 15);
+}
+
+/* extentHash         -- hash bucket of a file name              */
+static int extentHash(const struct cpmSuperBlock *sb, int user, const char *name, const char *ext)
+{
+  unsigned int h;
+  int i;
+
+  h=(unsigned char)user;
+  for (i=0; i<8; ++i) h=h*31+(name[i]&0x7f);
+  for (i=0; i<3; ++i) h=h*31+(ext[i]&0x7f);
+  return (int)(h&sb->extHashMask);
+}
+
+/* extentKey          -- sort key of an extent within its file   */
+static int extentKey(const struct cpmSuperBlock *sb, int entry)
+{
+  return EXTENT(sb->dir[entry].extnol,sb->dir[entry].extnoh);
+}
+
+/* indexFind          -- find the lowest extent of a file        */
+static int indexFind(const struct cpmSuperBlock *sb, int user, const char *name, const char *ext)
+{
+  int head;
+
+  for (head=sb->extHash[extentHash(sb,user,name,ext)]; head!=-1; head=sb->extHashNext[head])
+     if (isMatching(user,name,ext,sb->dir[head].status,sb->dir[head].name,sb->dir[head].ext))
+        return head;
+  return -1;
+}
+
+/* indexLinkFile      -- add a file (by its lowest extent) to the hash */
+static void indexLinkFile(const struct cpmSuperBlock *sb, int head)
+{
+  int bucket=extentHash(sb,sb->dir[head].status,sb->dir[head].name,sb->dir[head].ext);
+
+  sb->extHashNext[head]=sb->extHash[bucket];
+  sb->extHash[bucket]=head;
+}
+
+/* indexUnlinkFile    -- remove a file (by its lowest extent) from the hash */
+static void indexUnlinkFile(const struct cpmSuperBlock *sb, int head)
+{
+  int *link=&sb->extHash[extentHash(sb,sb->dir[head].status,sb->dir[head].name,sb->dir[head].ext)];
+
+  while (*link!=-1 && *link!=head) link=&sb->extHashNext[*link];
+  if (*link==head) *link=sb->extHashNext[head];
+}
+
+/* indexInsert        -- add a directory entry to the index      */
+static void indexInsert(const struct cpmSuperBlock *sb, int entry)
+{
+  int head,prev,cur,key;
+
+  if (!isFileExtent(sb,entry)) return;
+  key=extentKey(sb,entry);
+  head=indexFind(sb,sb->dir[entry].status,sb->dir[entry].name,sb->dir[entry].ext);
+  if (head==-1 || key<extentKey(sb,head) || (key==extentKey(sb,head) && entry<head))
+  {
+    /* new file or new lowest extent: the entry becomes the list head */
+    if (head!=-1) indexUnlinkFile(sb,head);
+    sb->extNext[entry]=head;
+    indexLinkFile(sb,entry);
+    return;
+  }
+  for (prev=head,cur=sb->extNext[head]; cur!=-1; prev=cur,cur=sb->extNext[cur])
+     if (key<extentKey(sb,cur) || (key==extentKey(sb,cur) && entry<cur)) break;
+  sb->extNext[entry]=cur;
+  sb->extNext[prev]=entry;
+}
+
+/* indexRemove        -- remove a directory entry from the index */
+static void indexRemove(const struct cpmSuperBlock *sb, int entry)
+{
+  int head,prev;
+
+  if (!isFileExtent(sb,entry)) return;
+  head=indexFind(sb,sb->dir[entry].status,sb->dir[entry].name,sb->dir[entry].ext);
+  if (head==-1) return;
+  if (head==entry)
+  {
+    indexUnlinkFile(sb,head);
+    if (sb->extNext[head]!=-1) indexLinkFile(sb,sb->extNext[head]);
+    return;
+  }
+  for (prev=head; sb->extNext[prev]!=-1 && sb->extNext[prev]!=entry; prev=sb->extNext[prev]);
+  if (sb->extNext[prev]==entry) sb->extNext[prev]=sb->extNext[entry];
+}
+
+/* indexBuild         -- index the whole in-core directory       */
+static int indexBuild(struct cpmSuperBlock *sb)
+{
+  int i,buckets;
+
+  for (buckets=16; buckets<sb->maxdir; buckets<<=1);
+  if ((sb->extHash=malloc(buckets*sizeof(int)))==(int*)0
+  || (sb->extHashNext=malloc(sb->maxdir*sizeof(int)))==(int*)0
+  || (sb->extNext=malloc(sb->maxdir*sizeof(int)))==(int*)0)
+  {
+    boo="out of memory";
+    return -1;
+  }
+  sb->extHashMask=buckets-1;
+  for (i=0; i<buckets; ++i) sb->extHash[i]=-1;
+  for (i=0; i<sb->maxdir; ++i) indexInsert(sb,i);
+  return 0;
+}
+
+/*============================================================================*/
+/* findFileExtent     -- find the lowest extent (extno -1) or the given     */
+/*                       extent for a file                                   */
 /*============================================================================*/
-static int findFileExtent(const struct cpmSuperBlock *sb, int user, const char *name, const char *ext, int start, int extno)
+static int findFileExtent(const struct cpmSuperBlock *sb, int user, const char *name, const char *ext, int extno)
 {
+  int extent,found=-1;
+
   boo="file already exists";
-  for (; start<sb->maxdir; ++start)
-     {
-      if (((unsigned char)sb->dir[start].status) <= (sb->type==CPMFS_P2DOS ? 31 : 15)
-      && (extno==-1 || (EXTENT(sb->dir[start].extnol,sb->dir[start].extnoh)/sb->extents) == (extno/sb->extents))
-      && isMatching(user,name,ext,sb->dir[start].status,sb->dir[start].name,sb->dir[start].ext)
-      ) return start;
-     }
+  for (extent=indexFind(sb,user,name,ext); extent!=-1; extent=sb->extNext[extent])
+  {
+    int group;
+
+    if (extno==-1) return extent;
+    group=extentKey(sb,extent)/sb->extents;
+    if (group>extno/sb->extents) break;
+    /* more than one entry for the same extent: use the first on disk */
+    if (group==extno/sb->extents && (found==-1 || extent<found)) found=extent;
+  }
+  if (found!=-1) return found;
   boo="file not found";
   return -1;
 }
@@ -1220,6 +1418,8 @@ int cpmReadSuper(struct cpmSuperBlock *d, struct cpmInode *root, const char *for
   {
     int i,blocks,entry;
 
+    Cache_open(&d->dev); /* whole track reads and write-back, see trackcache.h */
+
     blocks=(d->maxdir*32+d->blksiz-1)/d->blksiz;
     entry=0;
     for (i=0; i<blocks; ++i) 
@@ -1232,6 +1432,8 @@ int cpmReadSuper(struct cpmSuperBlock *d, struct cpmInode *root, const char *for
   /* uBee (MH 2.13) 2010/04/03 - end */
 
   alvInit(d);
+  d->alvNext=0;
+  if (indexBuild(d)==-1) return -1;
   if (d->type==CPMFS_DR3) /* read additional superblock information */
   {
     int i;
@@ -1374,10 +1576,9 @@ int cpmNamei(const struct cpmInode *dir, const char *filename, struct cpmInode *
     int extent;
 
     i->size=0;
-    extent=-1;
     highestExtno=-1;
     lowestExtno=2049;
-    while ((extent=findFileExtent(dir->sb,user,name,extension,extent+1,-1))!=-1)
+    for (extent=findFileExtent(dir->sb,user,name,extension,-1); extent!=-1; extent=dir->sb->extNext[extent])
     {
       int extno=EXTENT(dir->sb->dir[extent].extnol,dir->sb->dir[extent].extnoh);
 
@@ -1519,24 +1720,13 @@ void cpmStatFS(const struct cpmInode *ino, struct cpmStatFS *buf)
   buf->f_bused=-(d->maxdir * 32 + d->blksiz-1) / d->blksiz;
   for (i = 0; i < d->alvSize; ++i)
   {
-    int temp,j;
+    unsigned int bits=*(d->alv+i);
+    int valid=d->size-i*INTBITS,used;
 
-    temp = *(d->alv+i);
-    for (j=0; j<INTBITS; ++j)
-    {
-      if (i*INTBITS+j < d->size)
-      {
-        if (1&temp)
-        {
-#ifdef CPMFS_DEBUG
-          fprintf(stderr,"cpmStatFS: block %d allocated\n",(i*INTBITS+j));
-#endif
-          ++buf->f_bused;
-        }
-        else ++buf->f_bfree;
-      }
-      temp >>= 1;
-    }
+    if (valid<INTBITS) bits&=(1u<<valid)-1; else valid=INTBITS;
+    used=alvPopcount(bits);
+    buf->f_bused+=used;
+    buf->f_bfree+=valid-used;
   }
   buf->f_bavail=buf->f_bfree;
   buf->f_files=d->maxdir;
@@ -1568,15 +1758,15 @@ int cpmUnlink(const struct cpmInode *dir, const char *fname)
 
   if (splitFilename(fname,dir->sb->type,name,extension,&user)==-1)
      return -1;
-  if ((extent=findFileExtent(drive,user,name,extension,0,-1))==-1)
+  if ((extent=findFileExtent(drive,user,name,extension,-1))==-1)
      return -1;
 
   drive->dirtyDirectory=1; /* uBee (MH 2.13) 2010/04/03 */
-  drive->dir[extent].status=(char)0xe5;
-  do
+  indexUnlinkFile(drive,extent);
+  for (; extent!=-1; extent=drive->extNext[extent])
   {
     drive->dir[extent].status=(char)0xe5;
-  } while ((extent=findFileExtent(drive,user,name,extension,extent+1,-1))>=0);
+  }
   /* uBee (MH 2.13) 2010/04/03
   if (writePhysDirectory(drive)==-1) return -1;
   */  
@@ -1590,7 +1780,7 @@ int cpmUnlink(const struct cpmInode *dir, const char *fname)
 int cpmRename(const struct cpmInode *dir, const char *old, const char *new)
 {
   struct cpmSuperBlock *drive;
-  int extent;
+  int extent,head;
   int olduser;
   char oldname[8], oldext[3];
   int newuser;
@@ -1604,19 +1794,22 @@ int cpmRename(const struct cpmInode *dir, const char *old, const char *new)
   drive=dir->sb;
   if (splitFilename(old,dir->sb->type, oldname, oldext,&olduser)==-1) return -1;
   if (splitFilename(new,dir->sb->type, newname, newext,&newuser)==-1) return -1;
-  if ((extent=findFileExtent(drive,olduser,oldname,oldext,0,-1))==-1) return -1;
-  if (findFileExtent(drive,newuser,newname, newext,0,-1)!=-1) 
+  if ((extent=findFileExtent(drive,olduser,oldname,oldext,-1))==-1) return -1;
+  if (findFileExtent(drive,newuser,newname, newext,-1)!=-1) 
   {
     boo="file already exists";
     return -1;
   }
+  head=extent;
+  indexUnlinkFile(drive,head);
   do 
   {
     drive->dirtyDirectory=1; /* uBee (MH 2.13) 2010/04/03 */
     drive->dir[extent].status=newuser;
     memcpy7(drive->dir[extent].name, newname, 8);
     memcpy7(drive->dir[extent].ext, newext, 3);
-  } while ((extent=findFileExtent(drive,olduser,oldname,oldext,extent+1,-1))!=-1);
+  } while ((extent=drive->extNext[extent])!=-1);
+  indexLinkFile(drive,head);
   /* uBee (MH 2.13) 2010/04/03
   if (writePhysDirectory(drive)==-1) return -1;
   */  
@@ -1707,19 +1900,14 @@ int cpmReaddir(struct cpmFile *dir, struct cpmDirent *ent)
     }
     else if (dir->pos>=RESERVED_ENTRIES && dir->pos<dir->ino->sb->maxdir+RESERVED_ENTRIES)
     {
-      int first=dir->pos-RESERVED_ENTRIES;
-
       if ((cur=dir->ino->sb->dir+(dir->pos-RESERVED_ENTRIES))->status >= 0 && cur->status<=(dir->ino->sb->type==CPMFS_P2DOS ? 31 : 15))
       {
-        /* determine first extent for the current file */
-        for (i=0; i<dir->ino->sb->maxdir; ++i) if (i!=(dir->pos-RESERVED_ENTRIES))
-        {
-          if (isMatching(cur->status,cur->name,cur->ext,dir->ino->sb->dir[i].status,dir->ino->sb->dir[i].name,dir->ino->sb->dir[i].ext) &&
-          EXTENT(cur->extnol,cur->extnoh)>EXTENT(dir->ino->sb->dir[i].extnol,dir->ino->sb->dir[i].extnoh))
-             first=i;
-        }
-       
-        if (first==(dir->pos-RESERVED_ENTRIES))
+        /* determine first extent for the current file: the extent index
+           keeps the lowest extent at the head of the file's list, so the
+           entry is listed if no other extent of the file is lower */
+        int first=indexFind(dir->ino->sb,cur->status,cur->name,cur->ext);
+
+        if (first==-1 || EXTENT(cur->extnol,cur->extnoh)==extentKey(dir->ino->sb,first))
         {
           ent->ino=dir->pos-RESERVED_INODES;
           /* convert file name to UNIX style */
@@ -1777,6 +1965,7 @@ int cpmOpen(struct cpmInode *ino, struct cpmFile *file, mode_t mode)
     file->pos=0;
     file->ino=ino;
     file->mode=mode;
+    file->sizehint=0;
     return 0;
   }
   else
@@ -1791,7 +1980,7 @@ int cpmOpen(struct cpmInode *ino, struct cpmFile *file, mode_t mode)
 /*============================================================================*/
 int cpmRead(struct cpmFile *file, char *buf, int count)
 {
-  int findext=1,findblock=1,extent=-1,block=-1,extentno=-1,got=0,nextblockpos=-1,nextextpos=-1;
+  int findext=1,extent=-1,block=-1,extentno=-1,got=0,nextextpos=-1;
   int blocksize=file->ino->sb->blksiz;
   int extcap;
 
@@ -1819,53 +2008,65 @@ int cpmRead(struct cpmFile *file, char *buf, int count)
     return count;
   }
  
+  /* Transfer a block (or the part of it that was asked for) per pass
+   * instead of a byte at a time.  Whole blocks are read straight into the
+   * caller's buffer, partial head and tail blocks go through a bounce
+   * buffer and are copied out in one go.  Missing extents and unallocated
+   * blocks (holes) read as zeros. */
   else while (count>0 && file->pos<file->ino->size)
   {
     char buffer[16384];
+    int offset,chunk;
 
-    if (findext)
+    if (findext || file->pos==nextextpos)
     {
       extentno=file->pos/16384;
-      extent=findFileExtent(file->ino->sb,file->ino->sb->dir[file->ino->ino].status,file->ino->sb->dir[file->ino->ino].name,file->ino->sb->dir[file->ino->ino].ext,0,extentno);
+      extent=findFileExtent(file->ino->sb,file->ino->sb->dir[file->ino->ino].status,file->ino->sb->dir[file->ino->ino].name,file->ino->sb->dir[file->ino->ino].ext,extentno);
       nextextpos=(file->pos/extcap)*extcap+extcap;
       findext=0;
-      findblock=1;
     }
-    if (findblock)
+
+    offset=file->pos%blocksize;
+    chunk=blocksize-offset;
+    if (chunk>count) chunk=count;
+    if (chunk>file->ino->size-file->pos) chunk=file->ino->size-file->pos;
+
+    if (extent==-1) block=0;
+    else
     {
-      if (extent!=-1)
-      {
-        int start,end,ptr;
+      int ptr;
 
-        ptr=(file->pos%extcap)/blocksize;
-        if (file->ino->sb->size>=256) ptr*=2;
-        block=(unsigned char)file->ino->sb->dir[extent].pointers[ptr];
-        if (file->ino->sb->size>=256) block+=((unsigned char)file->ino->sb->dir[extent].pointers[ptr+1])<<8;
-        if (block==0)
-        {
-          memset(buffer,0,blocksize);
-        }
-        else
-        {
-          start=(file->pos%blocksize)/file->ino->sb->secLength;
-          end=((file->pos%blocksize+count)>blocksize ? blocksize-1 : (file->pos%blocksize+count-1))/file->ino->sb->secLength;
-          /* uBee 2009/09/28 - added report_files=1/0 to switch on and off */
-          report_file_acc = report_sides; /* uBee 2009/09/28 */
-          readBlock(file->ino->sb,block,buffer,start,end);
-          report_file_acc = 0; /* uBee 2009/09/28 */
-        }
-      }
-      nextblockpos=(file->pos/blocksize)*blocksize+blocksize;
-      findblock=0;
+      ptr=(file->pos%extcap)/blocksize;
+      if (file->ino->sb->size>=256) ptr*=2;
+      block=(unsigned char)file->ino->sb->dir[extent].pointers[ptr];
+      if (file->ino->sb->size>=256) block+=((unsigned char)file->ino->sb->dir[extent].pointers[ptr+1])<<8;
     }
-    if (file->pos<nextblockpos)
+
+    if (block==0)
     {
-      if (extent==-1) *buf++='\0'; else *buf++=buffer[file->pos%blocksize];
-      ++file->pos;
-      ++got;
-      --count;
+      memset(buf,0,chunk);
+    }
+    else
+    {
+      int start,end;
+
+      start=offset/file->ino->sb->secLength;
+      end=((offset+count)>blocksize ? blocksize-1 : (offset+count-1))/file->ino->sb->secLength;
+      /* uBee 2009/09/28 - added report_files=1/0 to switch on and off */
+      report_file_acc = report_sides; /* uBee 2009/09/28 */
+      if (chunk==blocksize) readBlock(file->ino->sb,block,buf,start,end);
+      else
+      {
+        readBlock(file->ino->sb,block,buffer,start,end);
+        memcpy(buf,buffer+offset,chunk);
+      }
+      report_file_acc = 0; /* uBee 2009/09/28 */
     }
-    else if (file->pos==nextextpos) findext=1; else findblock=1;
+
+    buf+=chunk;
+    file->pos+=chunk;
+    got+=chunk;
+    count-=chunk;
   }
 #ifdef CPMFS_DEBUG
   fprintf(stderr,"cpmRead: read %d bytes, now at position %ld\n",got,(long)file->pos);
@@ -1881,7 +2082,7 @@ int cpmWrite(struct cpmFile *file, const char *buf, int count)
   int findext=1,findblock=-1,extent=-1,extentno=-1,got=0,nextblockpos=-1,nextextpos=-1;
   int blocksize=file->ino->sb->blksiz;
   int extcap=(file->ino->sb->size<256 ? 16 : 8)*blocksize;
-  int block=-1,start=-1,end=-1,ptr=-1,last=-1;
+  int block=-1,start=-1,end=-1,ptr=-1,last=-1,moved,lastblock=-1;
   char buffer[16384];
 
   while (count>0)
@@ -1889,7 +2090,7 @@ int cpmWrite(struct cpmFile *file, const char *buf, int count)
     if (findext)
     {
       extentno=file->pos/16384;
-      extent=findFileExtent(file->ino->sb,file->ino->sb->dir[file->ino->ino].status,file->ino->sb->dir[file->ino->ino].name,file->ino->sb->dir[file->ino->ino].ext,0,extentno);
+      extent=findFileExtent(file->ino->sb,file->ino->sb->dir[file->ino->ino].status,file->ino->sb->dir[file->ino->ino].name,file->ino->sb->dir[file->ino->ino].ext,extentno);
       nextextpos=(file->pos/extcap)*extcap+extcap;
       if (extent==-1)
       {
@@ -1900,6 +2101,7 @@ int cpmWrite(struct cpmFile *file, const char *buf, int count)
         file->ino->sb->dir[extent].extnoh=EXTENTH(extentno);
         file->ino->sb->dir[extent].blkcnt=0;
         file->ino->sb->dir[extent].lrc=0;
+        indexInsert(file->ino->sb,extent);
         updateTimeStamps(file->ino,extent);
       }
       findext=0;
@@ -1914,7 +2116,20 @@ int cpmWrite(struct cpmFile *file, const char *buf, int count)
       if (file->ino->sb->size>=256) block+=((unsigned char)file->ino->sb->dir[extent].pointers[ptr+1])<<8;
       if (block==0) /* allocate new block, set start/end to cover it */
       {
-        if ((block=allocBlock(file->ino->sb))==-1) return (got==0 ? -1 : got);
+        int prev,want;
+        off_t endpos=file->pos+count;
+
+        /* follow on from the previous block of the extent, or the block
+           written last time round when this is the start of a new extent */
+        if (ptr>0)
+        {
+          if (file->ino->sb->size>=256) prev=((unsigned char)file->ino->sb->dir[extent].pointers[ptr-2])+(((unsigned char)file->ino->sb->dir[extent].pointers[ptr-1])<<8);
+          else prev=(unsigned char)file->ino->sb->dir[extent].pointers[ptr-1];
+        }
+        else prev=lastblock;
+        if (file->sizehint>endpos) endpos=file->sizehint;
+        want=(endpos-(file->pos/blocksize)*blocksize+blocksize-1)/blocksize;
+        if ((block=allocBlock(file->ino->sb,prev,want))==-1) return (got==0 ? -1 : got);
         file->ino->sb->dir[extent].pointers[ptr]=block&0xff;
         if (file->ino->sb->size>=256) file->ino->sb->dir[extent].pointers[ptr+1]=(block>>8)&0xff;
         start=0;
@@ -1945,6 +2160,7 @@ int cpmWrite(struct cpmFile *file, const char *buf, int count)
       --count;
     }
     (void)writeBlock(file->ino->sb,block,buffer,start,end);
+    lastblock=block;
     if (file->ino->sb->size<256) for (last=15; last>=0; --last)
     {
       if (file->ino->sb->dir[extent].pointers[last])
@@ -1961,8 +2177,11 @@ int cpmWrite(struct cpmFile *file, const char *buf, int count)
       }
     }
     if (last>0) extentno+=(last*blocksize)/extcap;
+    moved=(extentKey(file->ino->sb,extent)!=extentno); /* keep the index sorted */
+    if (moved) indexRemove(file->ino->sb,extent);
     file->ino->sb->dir[extent].extnol=EXTENTL(extentno);
     file->ino->sb->dir[extent].extnoh=EXTENTH(extentno);
+    if (moved) indexInsert(file->ino->sb,extent);
     file->ino->sb->dir[extent].blkcnt=((file->pos-1)%16384)/128+1;
     file->ino->sb->dir[extent].lrc=file->pos%128;
     updateTimeStamps(file->ino,extent);
@@ -2007,7 +2226,7 @@ int cpmCreat(struct cpmInode *dir, const char *fname, struct cpmInode *ino, mode
 #ifdef CPMFS_DEBUG
   fprintf(stderr,"cpmCreat: %s -> %d:%-.8s.%-.3s\n",fname,user,name,extension);
 #endif
-  if (findFileExtent(dir->sb,user,name,extension,0,-1)!=-1) return -1;
+  if (findFileExtent(dir->sb,user,name,extension,-1)!=-1) return -1;
   drive=dir->sb;
   if ((extent=findFreeExtent(dir->sb))==-1) return -1;
   ent=dir->sb->dir+extent;
@@ -2016,6 +2235,7 @@ int cpmCreat(struct cpmInode *dir, const char *fname, struct cpmInode *ino, mode
   ent->status=user;
   memcpy(ent->name,name,8);
   memcpy(ent->ext,extension,3);
+  indexInsert(drive,extent);
   ino->ino=extent;
   ino->mode=s_ifreg|mode;
   ino->size=0;
@@ -2069,11 +2289,12 @@ int cpmAttrSet(struct cpmInode *ino, cpm_attr_t attrib)
   if (attrib & CPM_ATTR_SYS)  extension[1] |= 0x80;
   if (attrib & CPM_ATTR_ARCV) extension[2] |= 0x80;
   
-  do 
+  /* attribute bits are not part of the index hash, so the list stays valid */
+  for (extent=findFileExtent(drive,user,name,extension,-1); extent!=-1; extent=drive->extNext[extent])
   {
     memcpy(drive->dir[extent].name, name, 8);
     memcpy(drive->dir[extent].ext, extension, 3);
-  } while ((extent=findFileExtent(drive, user,name,extension,extent+1,-1))!=-1);
+  }
   /* uBee (MH 2.13) 2010/04/03
   if (writePhysDirectory(drive)==-1) return -1;
   */
@@ -2109,6 +2330,8 @@ int cpmSync(struct cpmSuperBlock *sb)
 /*============================================================================*/
 int cpmSync(struct cpmSuperBlock *sb)
 {
+  const char *err;
+
   if (sb->dirtyDirectory)
   {
     int i,blocks,entry;
@@ -2122,20 +2345,31 @@ int cpmSync(struct cpmSuperBlock *sb)
     }
     sb->dirtyDirectory=0;
   }
+  if ((err=Cache_flush(&sb->dev)) || (err=Mem_sync(&sb->dev)))
+  {
+    boo=err;
+    return -1;
+  }
   return 0;
 }
 /* uBee (MH 2.13) 2010/04/03 */
 
 /*============================================================================*/
-/* cpmUmount          -- free super block                        */
+/* cpmUmount          -- write back and free super block             */
 /*============================================================================*/
-void cpmUmount(struct cpmSuperBlock *sb)
+int cpmUmount(struct cpmSuperBlock *sb)
 {
-  cpmSync(sb); /* uBee (MH 2.13) 2010/04/03 */
+  int ret;
+
+  ret=cpmSync(sb); /* uBee (MH 2.13) 2010/04/03 */
   free(sb->alv);
   free(sb->skewtab);
   free(sb->dir);
+  free(sb->extHash);
+  free(sb->extHashNext);
+  free(sb->extNext);
   if (sb->passwdLength) free(sb->passwd);
+  return ret;
 }
 
 /*============================================================================*/
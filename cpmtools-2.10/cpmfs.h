@@ -81,6 +81,7 @@ struct cpmFile
   mode_t mode;
   off_t pos;
   struct cpmInode *ino;
+  off_t sizehint; /* expected size when writing, 0 if unknown */
 };
 
 struct cpmDirent
@@ -131,6 +132,7 @@ struct cpmSuperBlock
   struct PhysDirectoryEntry *dir;
   int alvSize;
   int *alv;
+  int alvNext;        /* next-fit cursor for allocBlock */
   int *skewtab;
   int cnotatime;
   char *label;
@@ -139,6 +141,10 @@ struct cpmSuperBlock
   size_t passwdLength;
   struct cpmInode *root;
   int dirtyDirectory; /* uBee (MH 2.13) 2010/04/03 */
+  int *extHash;       /* extent index: hash bucket -> lowest extent of a file */
+  int *extHashNext;   /* extent index: next file in the same hash bucket */
+  int *extNext;       /* extent index: next extent of the same file */
+  int extHashMask;    /* extent index: number of hash buckets - 1 */
 };
 
 struct cpmStatFS
@@ -176,7 +182,7 @@ int cpmWrite(struct cpmFile *file, const char *buf, int count);
 int cpmClose(struct cpmFile *file);
 int cpmCreat(struct cpmInode *dir, const char *fname, struct cpmInode *ino, mode_t mode);
 int cpmSync(struct cpmSuperBlock *sb);
-void cpmUmount(struct cpmSuperBlock *sb);
+int cpmUmount(struct cpmSuperBlock *sb);
 int string_search (char *strg_array[], char *strg_find);
 void get_physical_values (int tracks, int heads, int sidedness, int track, int *cylinder, int *head);
 
@@ -416,13 +416,15 @@ int main(int argc, char *argv[])
     fprintf(stderr," -e    Work on Erased files only (as user 0).\n");  /* 2016/11/01 uBee */
     fprintf(stderr," -v    Report build version.\n");  /* 2010/03/31 uBee */
 #if HAVE_LIBDSK_H
-    fprintf(stderr," -T    libdsk type.\n");
+    fprintf(stderr," -T    libdsk type, or mem to work on a raw image in memory.\n");
     fprintf(stderr," -L x  LibDsk options (x) separated by spaces in double quotes\n");
     fprintf(stderr,"             hd : data rate for 1.4Mb 3.5\" in 3.5\" drive.\n");
     fprintf(stderr,"             dd : data rate for 360k 5.25\" in 1.2Mb drive.\n");
     fprintf(stderr,"             sd : data rate for 720k 3.5\" in 3.5\" drive.\n");
     fprintf(stderr,"             ed : data rate for 2.8Mb 3.5\" in 3.5\" drive.\n");
     fprintf(stderr,"          dstep : double step (40T disk in 80T drive)\n");
+#else
+    fprintf(stderr," -T    mem to work on a raw image in memory.\n");
 #endif
     exit(1);
   }
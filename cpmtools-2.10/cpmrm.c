@@ -56,13 +56,15 @@ int main(int argc, char *argv[])
     fprintf(stderr,"\nOther options:\n");
     fprintf(stderr," -v    Report build version.\n");  /* 2010/03/31 uBee */
 #if HAVE_LIBDSK_H
-    fprintf(stderr," -T    libdsk type.\n");
+    fprintf(stderr," -T    libdsk type, or mem to work on a raw image in memory.\n");
     fprintf(stderr," -L x  LibDsk options (x) separated by spaces in double quotes\n");
     fprintf(stderr,"             hd : data rate for 1.4Mb 3.5\" in 3.5\" drive.\n");
     fprintf(stderr,"             dd : data rate for 360k 5.25\" in 1.2Mb drive.\n");
     fprintf(stderr,"             sd : data rate for 720k 3.5\" in 3.5\" drive.\n");
     fprintf(stderr,"             ed : data rate for 2.8Mb 3.5\" in 3.5\" drive.\n");
     fprintf(stderr,"          dstep : double step (40T disk in 80T drive)\n");
+#else
+    fprintf(stderr," -T    mem to work on a raw image in memory.\n");
 #endif
     exit(1);
   }
@@ -84,6 +86,10 @@ int main(int argc, char *argv[])
       exitcode=1;
     }
   }
-  cpmUmount(&drive); /* uBee (MH 2.13) 2010/04/03 */
+  if (cpmUmount(&drive)==-1) /* uBee (MH 2.13) 2010/04/03 */
+  {
+    fprintf(stderr,"%s: can not write %s: %s\n",cmd,image,boo);
+    exitcode=1;
+  }
   exit(exitcode);
 }
@@ -8,6 +8,9 @@
 #define CPMDRV_WINNT 2 /* Windows NT floppy drive accessed via CreateFile */
 #endif
 
+struct trackCache;
+struct memImage;
+
 struct Device
 {
   int opened;
@@ -31,6 +34,8 @@ struct Device
   int sideoffs;  /* uBee 2015/01/13 */
   int testside;  /* uBee 2009/09/28 */
   int addoffs;   /* uBee 2009/09/28 */
+  struct trackCache *cache; /* see trackcache.h, 0 if not caching */
+  struct memImage *mem;     /* see device_mem.h, 0 unless '-T mem' */
 };
 
 const char *Device_open(struct Device *self, const char *filename, int mode, const char *deviceOpts);
@@ -55,6 +60,11 @@ const char *Device_writeSector(const struct Device *self, int track, int sector,
 const char *Device_readSector(const struct Device *self, int track, int sector, int lsector, int flags, char *buf);
 const char *Device_writeSector(const struct Device *self, int track, int sector, int lsector, int flags, const char *buf);
 
+/* Read or write all sectors of a data track in one go, physical sector order
+   starting with sector 'datasect'.  Used by the track cache (trackcache.h). */
+const char *Device_readTrack(const struct Device *self, int track, char *buf);
+const char *Device_writeTrack(const struct Device *self, int track, const int *lsector, const char *buf);
+
 #if HAVE_LIBDSK_H
 void Device_libdsk_options (char *libdsk_opts);
 #endif
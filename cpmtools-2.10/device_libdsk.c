@@ -18,6 +18,8 @@
 
 #include "cpmfs.h"      /* uBee 2014/02/03 */
 #include "device.h"
+#include "trackcache.h"
+#include "device_mem.h"
 
 #ifdef USE_DMALLOC
 #include <dmalloc.h>
@@ -109,6 +111,9 @@ const char *Device_open(struct Device *this, const char *filename, int mode, con
  dsk_err_t dsk_err;
  int fd;
 
+ this->cache = (struct trackCache*)0;
+ this->mem = (struct memImage*)0;
+
  if (deviceOpts != NULL)
     {
      strncpy(device_type, deviceOpts, sizeof(device_type)-1);
@@ -126,6 +131,10 @@ const char *Device_open(struct Device *this, const char *filename, int mode, con
  else
     strcpy(device_type, "raw");
  /* end added code - uBee 2009/12/11, 2010/02/21, 2010/03/11 */
+
+ /* '-T mem' is not a LibDsk type: the raw image is held in memory instead */
+ if (Mem_isType(device_type))
+    return Mem_open(this, filename, mode);
     
  /* uBee 2009/09/28  dsk_err_t e = dsk_open(&this->dev, filename, deviceOpts, NULL); */
   dsk_err = dsk_open(&this->dev, filename, device_type, NULL); /* uBee 2009/09/28 */
@@ -288,9 +297,19 @@ void Device_setGeometry(struct Device *this, struct cpmSuperBlock *d)  /* uBee 2
 const char *Device_close(struct Device *this)
 {
   dsk_err_t dsk_err;
+  const char *err,*merr;
+
+  /* the cache may still hold writes, its error is the one to report */
+  err=Cache_close(this);
+  if (this->mem)
+  {
+     merr=Mem_close(this);
+     return (err?err:merr);
+  }
   this->opened=0;
   dsk_err = dsk_close(&this->dev);
-  return (dsk_err?dsk_strerror(dsk_err):(const char*)0);
+  if (dsk_err && !err) err=dsk_strerror(dsk_err);
+  return err;
 }
 
 /*
@@ -335,6 +354,9 @@ int lsector, int flags, char *buf)
  int min_sector;
  int max_sector;
 
+ if (this->mem)
+    return Mem_readSector(this, track, sector, buf);
+
  /* determine what the allowed sector range is - uBee 2016/07/18 */
  sector_minmax(this, flags, &min_sector, &max_sector);
 
@@ -455,6 +477,9 @@ int lsector, int flags, const char *buf)
  int min_sector;
  int max_sector;
 
+ if (this->mem)
+    return Mem_writeSector(this, track, sector, buf);
+
  /* determine what the allowed sector range is - uBee 2016/07/18 */
  sector_minmax(this, flags, &min_sector, &max_sector);
 
@@ -529,6 +554,67 @@ int lsector, int flags, const char *buf)
   return (dsk_err?dsk_strerror(dsk_err):(const char*)0);
 }
 
+/*
+================================================================================
+ Device_readTrack - read all sectors of a data track for the track cache.
+
+ When the side ID does not need checking the whole track is fetched with
+ dsk_ptread(), otherwise (or if that fails) it is read a sector at a time
+ through Device_readSector() which handles the ID checks and errors.
+================================================================================
+*/
+const char *Device_readTrack(const struct Device *this, int track, char *buf)
+{
+ const char *err;
+ int head;
+ int cylinder;
+ int i;
+
+ if (this->mem)
+    return Mem_readTrack(this, track, buf);
+
+ if (! this->testside)
+    {
+     get_physical_values(this->geom.dg_cylinders, this->geom.dg_heads,
+     this->sidedness, track, &cylinder, &head);
+
+     if (cylinder < this->geom.dg_cylinders &&
+     dsk_ptread(this->dev, &this->geom, buf, cylinder, head) == DSK_ERR_OK)
+        return NULL;
+    }
+
+ for (i = 0; i < this->sectrk; i++)
+    {
+     if ((err = Device_readSector(this, track, this->datasect + i, i, 0, buf + i * this->secLength)))
+        return err;
+    }
+ return NULL;
+}
+
+/*
+================================================================================
+ Device_writeTrack - write all sectors of a data track for the track cache.
+
+ LibDsk has no track write, so this is done a sector at a time, each with
+ the logical sector the cache recorded when it was written.
+================================================================================
+*/
+const char *Device_writeTrack(const struct Device *this, int track, const int *lsector, const char *buf)
+{
+ const char *err;
+ int i;
+
+ if (this->mem)
+    return Mem_writeTrack(this, track, buf);
+
+ for (i = 0; i < this->sectrk; i++)
+    {
+     if ((err = Device_writeSector(this, track, this->datasect + i, lsector[i], 0, buf + i * this->secLength)))
+        return err;
+    }
+ return NULL;
+}
+
 /*
 ================================================================================
  uBee 2009/09/28
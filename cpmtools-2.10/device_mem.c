@@ -0,0 +1,304 @@
+#include "config.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "device.h"
+#include "device_mem.h"
+
+#ifdef USE_DMALLOC
+#include <dmalloc.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/*
+================================================================================
+ Mem_isType            -- does the -T option ask for the memory device?
+================================================================================
+*/
+int Mem_isType(const char *deviceOpts)
+{
+  int i;
+
+  if (deviceOpts==(const char*)0) return 0;
+  for (i=0; MEM_DEVICE_TYPE[i]; ++i)
+     if (tolower((unsigned char)deviceOpts[i])!=MEM_DEVICE_TYPE[i]) return 0;
+  return deviceOpts[i]=='\0';
+}
+
+/*
+================================================================================
+ Mem_open              -- map or load an image file
+================================================================================
+*/
+const char *Mem_open(struct Device *this, const char *filename, int mode)
+{
+  struct memImage *m;
+  struct stat statbuf;
+  int fd;
+
+  this->opened=0;
+  if ((fd=open(filename,O_BINARY|O_RDONLY))==-1) return strerror(errno);
+  if (fstat(fd,&statbuf)==-1 || (m=malloc(sizeof(struct memImage)))==(struct memImage*)0)
+  {
+    close(fd);
+    return "out of memory";
+  }
+  memset(m,0,sizeof(struct memImage));
+  m->writable=((mode&O_ACCMODE)!=O_RDONLY);
+  m->fileMode=statbuf.st_mode&0777;
+  m->length=m->size=statbuf.st_size;
+  if ((m->name=malloc(strlen(filename)+1))==(char*)0)
+  {
+    free(m);
+    close(fd);
+    return "out of memory";
+  }
+  strcpy(m->name,filename);
+
+#ifndef _WIN32
+  if (m->size)
+  {
+    /* private mapping: writes never reach the file until committed */
+    m->data=mmap((void*)0,m->size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+    if (m->data==(char*)MAP_FAILED) m->data=(char*)0; else m->mapped=1;
+  }
+#endif
+  if (!m->mapped && m->size)
+  {
+    size_t got=0;
+    int res;
+
+    if ((m->data=malloc(m->size))==(char*)0)
+    {
+      free(m->name);
+      free(m);
+      close(fd);
+      return "out of memory";
+    }
+    while (got<m->size && (res=read(fd,m->data+got,m->size-got))>0) got+=res;
+    if (got<m->size) memset(m->data+got,0,m->size-got);
+  }
+  close(fd);
+  this->mem=m;
+  this->opened=1;
+  return (const char*)0;
+}
+
+#ifndef _WIN32
+/*
+================================================================================
+ syncDirectory         -- make a rename in the directory of a file durable
+================================================================================
+*/
+static const char *syncDirectory(const char *name)
+{
+  const char *slash=strrchr(name,'/');
+  char *dir;
+  int fd,res;
+
+  if ((dir=malloc(strlen(name)+2))==(char*)0) return "out of memory";
+  if (slash==(const char*)0) strcpy(dir,".");
+  else
+  {
+    memcpy(dir,name,slash-name+1);
+    dir[slash-name+1]='\0';
+  }
+  fd=open(dir,O_RDONLY);
+  free(dir);
+  if (fd==-1) return strerror(errno);
+  res=fsync(fd);
+  if (close(fd)==-1 || res==-1) return strerror(errno);
+  return (const char*)0;
+}
+#endif
+
+/*
+================================================================================
+ commit                -- write the image to a temporary file and rename it
+                          over the original
+================================================================================
+*/
+static const char *commit(struct memImage *m)
+{
+  char *tmp;
+  size_t put=0;
+  int fd,res;
+
+  if ((tmp=malloc(strlen(m->name)+8))==(char*)0) return "out of memory";
+  sprintf(tmp,"%s.XXXXXX",m->name);
+#ifdef _WIN32
+  if (_mktemp(tmp)==(char*)0 || (fd=open(tmp,O_BINARY|O_CREAT|O_EXCL|O_WRONLY,0666))==-1)
+#else
+  if ((fd=mkstemp(tmp))==-1)
+#endif
+  {
+    free(tmp);
+    return strerror(errno);
+  }
+  while (put<m->length && (res=write(fd,m->data+put,m->length-put))>0) put+=res;
+#ifndef _WIN32
+  if (put==m->length && fchmod(fd,m->fileMode)==-1) put=0;
+  if (put==m->length && fsync(fd)==-1) put=0;
+#endif
+  if (close(fd)==-1 || put!=m->length)
+  {
+    const char *err=strerror(errno);
+
+    remove(tmp);
+    free(tmp);
+    return err;
+  }
+#ifdef _WIN32
+  remove(m->name); /* rename() does not replace files here */
+#endif
+  if (rename(tmp,m->name)==-1)
+  {
+    const char *err=strerror(errno);
+
+    remove(tmp);
+    free(tmp);
+    return err;
+  }
+  free(tmp);
+  m->dirty=0;
+#ifndef _WIN32
+  /* the new name is only safe once the directory is on disk */
+  return syncDirectory(m->name);
+#else
+  return (const char*)0;
+#endif
+}
+
+/*
+================================================================================
+ Mem_sync              -- commit changes made so far
+
+ Not all tools close the device, so cpmSync() calls this as well.
+================================================================================
+*/
+const char *Mem_sync(const struct Device *this)
+{
+  struct memImage *m=this->mem;
+
+  if (m==(struct memImage*)0 || !m->writable || !m->dirty) return (const char*)0;
+  return commit(m);
+}
+
+/*
+================================================================================
+ Mem_close             -- commit changes and release the image
+================================================================================
+*/
+const char *Mem_close(struct Device *this)
+{
+  struct memImage *m=this->mem;
+  const char *err;
+
+  if (m==(struct memImage*)0) return (const char*)0;
+  err=Mem_sync(this);
+#ifndef _WIN32
+  if (m->mapped) munmap(m->data,m->size); else
+#endif
+  free(m->data);
+  free(m->name);
+  free(m);
+  this->mem=(struct memImage*)0;
+  this->opened=0;
+  return err;
+}
+
+/*
+================================================================================
+ sectorOffset          -- byte offset of a data sector in the image
+================================================================================
+*/
+static size_t sectorOffset(const struct Device *this, int track, int sector)
+{
+  sector -= this->datasect; /* make the sector 0 based */
+  assert(sector>=0);
+  assert(sector<this->sectrk);
+  assert(track>=0);
+  assert(track<this->tracks);
+  return ((size_t)track*this->sectrk+sector)*this->secLength;
+}
+
+/*
+================================================================================
+ readBytes / writeBytes -- copy to and from the image, growing it on writes
+                           past the end (reads there return zeros)
+================================================================================
+*/
+static void readBytes(const struct memImage *m, size_t offset, char *buf, size_t len)
+{
+  size_t have=0;
+
+  if (offset<m->length) have=(m->length-offset<len) ? m->length-offset : len;
+  if (have) memcpy(buf,m->data+offset,have);
+  if (have<len) memset(buf+have,0,len-have);
+}
+
+static const char *writeBytes(const struct Device *this, size_t offset, const char *buf, size_t len)
+{
+  struct memImage *m=this->mem;
+
+  if (!m->writable) return strerror(EBADF);
+  if (offset+len>m->size)
+  {
+    size_t size=(size_t)this->tracks*this->sectrk*this->secLength;
+    char *data;
+
+    if (size<offset+len) size=offset+len;
+    if ((data=malloc(size))==(char*)0) return "out of memory";
+    if (m->length) memcpy(data,m->data,m->length);
+    memset(data+m->length,0,size-m->length);
+#ifndef _WIN32
+    if (m->mapped) munmap(m->data,m->size); else
+#endif
+    free(m->data);
+    m->data=data;
+    m->size=size;
+    m->mapped=0;
+  }
+  memcpy(m->data+offset,buf,len);
+  if (offset+len>m->length) m->length=offset+len;
+  m->dirty=1;
+  return (const char*)0;
+}
+
+/*
+================================================================================
+ Mem_readSector / Mem_writeSector / Mem_readTrack / Mem_writeTrack
+================================================================================
+*/
+const char *Mem_readSector(const struct Device *this, int track, int sector, char *buf)
+{
+  readBytes(this->mem,sectorOffset(this,track,sector),buf,this->secLength);
+  return (const char*)0;
+}
+
+const char *Mem_writeSector(const struct Device *this, int track, int sector, const char *buf)
+{
+  return writeBytes(this,sectorOffset(this,track,sector),buf,this->secLength);
+}
+
+const char *Mem_readTrack(const struct Device *this, int track, char *buf)
+{
+  readBytes(this->mem,sectorOffset(this,track,this->datasect),buf,(size_t)this->sectrk*this->secLength);
+  return (const char*)0;
+}
+
+const char *Mem_writeTrack(const struct Device *this, int track, const char *buf)
+{
+  return writeBytes(this,sectorOffset(this,track,this->datasect),buf,(size_t)this->sectrk*this->secLength);
+}
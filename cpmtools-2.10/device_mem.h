@@ -0,0 +1,44 @@
+#ifndef DEVICE_MEM_H
+#define DEVICE_MEM_H
+
+/*
+================================================================================
+ In-memory image device, selected with '-T mem'.
+
+ The whole of a raw image file is mapped (or on systems without mmap,
+ loaded) into memory and sectors are accessed by pointer arithmetic.
+ Writes go to a private copy.  If anything was written the image is
+ committed on cpmSync() and Device_close() by writing a temporary file
+ next to the image, syncing it and renaming it over the original, so an
+ interrupted run leaves the old image intact.
+
+ Only raw (flat) images are supported, laid out as for device_posix.c.
+================================================================================
+*/
+
+#define MEM_DEVICE_TYPE "mem"
+
+struct Device;
+
+struct memImage
+{
+  char *name;       /* image file name, for the commit */
+  char *data;       /* image contents */
+  size_t length;    /* bytes of image held in data */
+  size_t size;      /* bytes allocated (or mapped) at data */
+  int mapped;       /* data is a private mapping of the file */
+  int writable;     /* opened for writing */
+  int dirty;        /* data differs from the file */
+  int fileMode;     /* permissions of the original file */
+};
+
+int Mem_isType(const char *deviceOpts);
+const char *Mem_open(struct Device *this, const char *filename, int mode);
+const char *Mem_sync(const struct Device *this);
+const char *Mem_close(struct Device *this);
+const char *Mem_readSector(const struct Device *this, int track, int sector, char *buf);
+const char *Mem_writeSector(const struct Device *this, int track, int sector, const char *buf);
+const char *Mem_readTrack(const struct Device *this, int track, char *buf);
+const char *Mem_writeTrack(const struct Device *this, int track, const char *buf);
+
+#endif
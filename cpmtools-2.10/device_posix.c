@@ -6,6 +6,8 @@
 #include <string.h>
 
 #include "device.h"
+#include "trackcache.h"
+#include "device_mem.h"
 
 #ifdef USE_DMALLOC
 #include <dmalloc.h>
@@ -15,6 +17,9 @@
 /* Device_open           -- Open an image file                      */
 const char *Device_open(struct Device *this, const char *filename, int mode, const char *deviceOpts)
 {
+  this->cache=(struct trackCache*)0;
+  this->mem=(struct memImage*)0;
+  if (Mem_isType(deviceOpts)) return Mem_open(this,filename,mode);
   this->fd=open(filename,mode);
   this->opened=(this->fd==-1?0:1);
   return ((this->fd==-1)?strerror(errno):(const char*)0);
@@ -42,8 +47,18 @@ void Device_setGeometry(struct Device *this, struct cpmSuperBlock *d)  /* uBee 2
 /* Device_close          -- Close an image file                     */
 const char *Device_close(struct Device *this)
 {
+  const char *err,*merr;
+
+  /* the cache may still hold writes, its error is the one to report */
+  err=Cache_close(this);
+  if (this->mem)
+  {
+    merr=Mem_close(this);
+    return (err?err:merr);
+  }
   this->opened=0;
-  return ((close(this->fd)==-1)?strerror(errno):(const char*)0);
+  if (close(this->fd)==-1 && !err) err=strerror(errno);
+  return err;
 }
 
 /*
@@ -62,6 +77,7 @@ const char *Device_readSector(const struct Device *this, int track, int sector,
 {
   int res;
 
+  if (this->mem) return Mem_readSector(this,track,sector,buf);
   sector -= this->datasect; /* make the sector 0 based uBee 2009/09/28 */
   assert(sector>=0);
   assert(sector<this->sectrk);
@@ -96,6 +112,7 @@ const char *Device_readSector(const struct Device *this, int track, int sector,
 /* Device_writeSector    -- write physical sector                   */
 const char *Device_writeSector(const struct Device *this, int track, int sector, int lsector, int flags, const char *buf)
 {
+  if (this->mem) return Mem_writeSector(this,track,sector,buf);
   sector -= this->datasect; /* make the sector 0 based - uBee 2009/09/28 */
   assert(sector>=0);
   assert(sector<this->sectrk);
@@ -108,3 +125,42 @@ const char *Device_writeSector(const struct Device *this, int track, int sector,
   if (write(this->fd, buf, this->secLength) == this->secLength) return (const char*)0;
   return strerror(errno);
 }
+
+/* Device_readTrack      -- read all sectors of a track             */
+const char *Device_readTrack(const struct Device *this, int track, char *buf)
+{
+  int res,bytes=this->sectrk*this->secLength;
+
+  if (this->mem) return Mem_readTrack(this,track,buf);
+  assert(track>=0);
+  assert(track<this->tracks);
+  if (lseek(this->fd,(off_t)track*bytes,SEEK_SET)==-1)
+  {
+    return strerror(errno);
+  }
+  if ((res=read(this->fd, buf, bytes)) != bytes)
+  {
+    if (res==-1)
+    {
+      return strerror(errno);
+    }
+    else memset(buf+res,0,bytes-res); /* hit end of disk image */
+  }
+  return (const char*)0;
+}
+
+/* Device_writeTrack     -- write all sectors of a track            */
+const char *Device_writeTrack(const struct Device *this, int track, const int *lsector, const char *buf)
+{
+  int bytes=this->sectrk*this->secLength;
+
+  if (this->mem) return Mem_writeTrack(this,track,buf);
+  assert(track>=0);
+  assert(track<this->tracks);
+  if (lseek(this->fd,(off_t)track*bytes, SEEK_SET)==-1)
+  {
+    return strerror(errno);
+  }
+  if (write(this->fd, buf, bytes) == bytes) return (const char*)0;
+  return strerror(errno);
+}
@@ -6,6 +6,8 @@
 
 #include "cpmdir.h"
 #include "cpmfs.h"
+#include "trackcache.h"
+#include "device_mem.h"
 
 #ifdef USE_DMALLOC
 #include <dmalloc.h>
@@ -262,6 +264,10 @@ static int w32mode(int mode)
 /* Device_open           -- Open an image file                      */
 const char *Device_open(struct Device *sb, const char *filename, int mode, const char *deviceOpts)
 {
+    sb->cache = (struct trackCache*)0;
+    sb->mem = (struct memImage*)0;
+    if (Mem_isType(deviceOpts)) return Mem_open(sb, filename, mode);
+
     /* Windows 95/NT: floppy drives using handles */ 
     if (strlen(filename) == 2 && filename[1] == ':')    /* Drive name */
     {
@@ -456,22 +462,31 @@ void Device_setGeometry(struct Device *this, struct cpmSuperBlock *d)  /* uBee 2
 /* Device_close          -- Close an image file                     */
 const char *Device_close(struct Device *sb)
 {
+    const char *err, *merr;
+
+    /* the cache may still hold writes, its error is the one to report */
+    err = Cache_close(sb);
+    if (sb->mem)
+    {
+        merr = Mem_close(sb);
+        return err ? err : merr;
+    }
     sb->opened = 0;
     switch(sb->drvtype)
     {
         case CPMDRV_WIN95:
             UnlockLogicalVolume(sb->hdisk, sb->fd );
-            if (!CloseHandle( sb->hdisk )) return strwin32error();
-            return NULL;
+            if (!CloseHandle( sb->hdisk ) && !err) return strwin32error();
+            return err;
 
         case CPMDRV_WINNT:
             DismountVolume(sb->hdisk);
             UnlockVolume(sb->hdisk);
-            if (!CloseHandle(sb->hdisk)) return strwin32error();
-            return NULL; 
+            if (!CloseHandle(sb->hdisk) && !err) return strwin32error();
+            return err; 
     }
-    if (close(sb->fd)) return strerror(errno);
-    return NULL; 
+    if (close(sb->fd) && !err) return strerror(errno);
+    return err; 
 }
 
 /*
@@ -491,6 +506,7 @@ const char *Device_readSector(const struct Device *drive, int track, int sector,
   int res;
   off_t offset;
 
+  if (drive->mem) return Mem_readSector(drive, track, sector, buf);
   sector -= this->datasect; /* make the sector 0 based uBee 2009/09/28 */
   assert(sector>=0);
   assert(sector<drive->sectrk);
@@ -604,6 +620,7 @@ const char *Device_writeSector(const struct Device *drive, int track, int sector
   off_t offset;
   int res;
 
+  if (drive->mem) return Mem_writeSector(drive, track, sector, buf);
   sector -= this->datasect; /* make the sector 0 based - uBee 2009/09/28 */
   assert(sector>=0);
   assert(sector<drive->sectrk);
@@ -687,3 +704,27 @@ const char *Device_writeSector(const struct Device *drive, int track, int sector
   if (write(drive->fd, buf, drive->secLength) == drive->secLength) return NULL;
   return strerror(errno);
 }
+
+/* Device_readTrack      -- read all sectors of a track             */
+const char *Device_readTrack(const struct Device *drive, int track, char *buf)
+{
+  const char *err;
+  int i;
+
+  if (drive->mem) return Mem_readTrack(drive,track,buf);
+  for (i=0; i<drive->sectrk; ++i)
+     if ((err=Device_readSector(drive,track,drive->datasect+i,i,0,buf+i*drive->secLength))) return err;
+  return NULL;
+}
+
+/* Device_writeTrack     -- write all sectors of a track            */
+const char *Device_writeTrack(const struct Device *drive, int track, const int *lsector, const char *buf)
+{
+  const char *err;
+  int i;
+
+  if (drive->mem) return Mem_writeTrack(drive,track,buf);
+  for (i=0; i<drive->sectrk; ++i)
+     if ((err=Device_writeSector(drive,track,drive->datasect+i,lsector[i],0,buf+i*drive->secLength))) return err;
+  return NULL;
+}
@@ -97,6 +97,44 @@ static int mkfs(struct cpmSuperBlock *drive, const char *name, const char *label
   return 0;
 }
 /*}}}*/
+/* sysgen -- write the system tracks of an existing image */ /*{{{*/
+/* The file system is left alone.  This goes through the device, so it works
+   on LibDsk images as well as raw ones.  Sectors are written in physical
+   order from sector 1, the order the boot rom and a loader read them in. */
+static int sysgen(struct cpmSuperBlock *drive, const char *name, const char *devopts, char *bootTracks)
+{
+  /* variables */ /*{{{*/
+  const char *err;
+  int track,sector,first;
+  /*}}}*/
+
+  /* a raw image has no sector ids, its system tracks are numbered like the data tracks */
+  first=(devopts==(const char*)0 || strcmp(devopts,"raw")==0 || strcmp(devopts,"mem")==0) ? drive->datasect : 1;
+
+  if ((err=Device_open(&drive->dev,name,O_RDWR,devopts)))
+  {
+    boo=err;
+    return -1;
+  }
+  Device_setGeometry(&drive->dev,drive);
+  for (track=0; track<drive->boottrk; ++track) for (sector=0; sector<drive->sectrk; ++sector)
+  {
+    /* flags 0x02: sector ids from 1 on a system track */
+    if ((err=Device_writeSector(&drive->dev,track,first+sector,sector,first==1 ? 0x02 : 0,bootTracks+(track*drive->sectrk+sector)*drive->secLength)))
+    {
+      boo=err;
+      Device_close(&drive->dev);
+      return -1;
+    }
+  }
+  if ((err=Device_close(&drive->dev)))
+  {
+    boo=err;
+    return -1;
+  }
+  return 0;
+}
+/*}}}*/
 
 const char cmd[]="mkfs.cpm";
 
@@ -108,11 +146,13 @@ int main(int argc, char *argv[]) /*{{{*/
   struct cpmSuperBlock drive;
   struct cpmInode root;
   const char *label="unlabeled";
+  const char *devopts=(const char*)0;
+  int systemOnly=0;
   size_t bootTrackSize,used;
   char *bootTracks;
   const char *boot[4]={(const char*)0,(const char*)0,(const char*)0,(const char*)0};
 
-  while ((c=getopt(argc,argv,"b:f:L:h?"))!=EOF) switch(c)
+  while ((c=getopt(argc,argv,"b:f:L:sT:h?"))!=EOF) switch(c)
   {
     case 'b':
     {
@@ -125,6 +165,8 @@ int main(int argc, char *argv[]) /*{{{*/
     }
     case 'f': format=optarg; break;
     case 'L': label=optarg; break;
+    case 's': systemOnly=1; break;
+    case 'T': devopts=optarg; break;
     case 'h':
     case '?': usage=1; break;
   }
@@ -134,7 +176,7 @@ int main(int argc, char *argv[]) /*{{{*/
 
   if (usage)
   {
-    fprintf(stderr,"Usage: %s [-f format] [-b boot] [-L label] image\n",cmd);
+    fprintf(stderr,"Usage: %s [-f format] [-b boot] [-L label] [-s [-T libdsk-type]] image\n",cmd);
     exit(1);
   }
   drive.dev.opened=0;
@@ -151,6 +193,7 @@ int main(int argc, char *argv[]) /*{{{*/
   {
     int fd;
     size_t size;
+    char more;
 
     if ((fd=open(boot[c],O_BINARY|O_RDONLY))==-1)
     {
@@ -158,6 +201,11 @@ int main(int argc, char *argv[]) /*{{{*/
       exit(1);
     }
     size=read(fd,bootTracks+used,bootTrackSize-used);
+    if (used+size==bootTrackSize && read(fd,&more,1)==1)
+    {
+      fprintf(stderr,"%s: %s does not fit in the system tracks\n",cmd,boot[c]);
+      exit(1);
+    }
 #if 0
     fprintf(stderr,"%d %04x %s\n",c,used+0x800,boot[c]);
 #endif
@@ -165,11 +213,19 @@ int main(int argc, char *argv[]) /*{{{*/
     used+=size;
     close(fd);
   }
-  if (mkfs(&drive,image,label,bootTracks)==-1)
+  if (systemOnly)
+  {
+    if (sysgen(&drive,image,devopts,bootTracks)==-1)
+    {
+      fprintf(stderr,"%s: can not write system tracks: %s\n",cmd,boo);
+      exit(1);
+    }
+  }
+  else if (mkfs(&drive,image,label,bootTracks)==-1)
   {
     fprintf(stderr,"%s: can not make new file system: %s\n",cmd,boo);
     exit(1);
   }
-  else exit(0);
+  exit(0);
 }
 /*}}}*/
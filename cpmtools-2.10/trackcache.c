@@ -0,0 +1,267 @@
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "device.h"
+#include "trackcache.h"
+
+#ifdef USE_DMALLOC
+#include <dmalloc.h>
+#endif
+
+static struct trackCacheStats stats;
+
+/*
+================================================================================
+ Cache_report          -- print the counters at exit, if asked for
+================================================================================
+*/
+static void Cache_report(void)
+{
+  fprintf(stderr,"track cache: %lu hits, %lu misses, %lu track reads, %lu track writes, %lu sector writes\n",
+  stats.hits,stats.misses,stats.trackReads,stats.trackWrites,stats.sectorWrites);
+}
+
+/*
+================================================================================
+ Cache_open            -- set up the cache once the geometry is known
+================================================================================
+*/
+void Cache_open(struct Device *this)
+{
+  static int reporting;
+  struct trackCache *c;
+  const char *s;
+  int lines,i;
+
+  Cache_close(this);
+  if (!reporting && getenv("CPMTOOLS_CACHE_STATS"))
+  {
+    atexit(Cache_report);
+    reporting=1;
+  }
+  lines=CACHE_TRACKS;
+  if ((s=getenv("CPMTOOLS_CACHE"))!=(const char*)0) lines=atoi(s);
+  /* nothing to gain on an image that is already in memory */
+  if (lines<=0 || this->mem || this->sectrk<=0 || this->secLength<=0) return;
+
+  if ((c=malloc(sizeof(struct trackCache)))==(struct trackCache*)0) return;
+  memset(c,0,sizeof(struct trackCache));
+  c->lines=lines;
+  c->trackBytes=this->sectrk*this->secLength;
+  c->line=malloc(lines*sizeof(struct trackCacheLine));
+  c->scratch=malloc(c->trackBytes);
+  if (c->line==(struct trackCacheLine*)0 || c->scratch==(char*)0)
+  {
+    free(c->line);
+    free(c->scratch);
+    free(c);
+    return;
+  }
+  for (i=0; i<lines; ++i)
+  {
+    c->line[i].track=-1;
+    c->line[i].used=0;
+    c->line[i].dirtyCount=0;
+    c->line[i].data=(char*)0;
+    c->line[i].valid=(char*)0;
+    c->line[i].dirty=(char*)0;
+    c->line[i].lsector=(int*)0;
+  }
+  this->cache=c;
+}
+
+/*
+================================================================================
+ flushLine             -- write the dirty sectors of a line back
+
+ A track that is completely dirty goes out with one Device_writeTrack(),
+ otherwise only the dirty sectors are written. Only written sectors have a
+ logical sector recorded, so a track with clean sectors is never written
+ whole.
+================================================================================
+*/
+static const char *flushLine(const struct Device *this, struct trackCacheLine *l)
+{
+  const char *err;
+  int i;
+
+  if (l->track==-1 || l->dirtyCount==0) return (const char*)0;
+  if (l->dirtyCount==this->sectrk)
+  {
+    if ((err=Device_writeTrack(this,l->track,l->lsector,l->data))) return err;
+    ++stats.trackWrites;
+  }
+  else for (i=0; i<this->sectrk; ++i) if (l->dirty[i])
+  {
+    if ((err=Device_writeSector(this,l->track,i+this->datasect,l->lsector[i],0,l->data+i*this->secLength))) return err;
+    ++stats.sectorWrites;
+  }
+  memset(l->dirty,0,this->sectrk);
+  l->dirtyCount=0;
+  return (const char*)0;
+}
+
+/*
+================================================================================
+ getLine               -- find the line holding a track, or recycle the least
+                          recently used one for it
+================================================================================
+*/
+static struct trackCacheLine *getLine(const struct Device *this, int track, int *hit, const char **err)
+{
+  struct trackCache *c=this->cache;
+  struct trackCacheLine *l,*lru;
+  int i;
+
+  *err=(const char*)0;
+  for (i=0,lru=c->line; i<c->lines; ++i)
+  {
+    l=c->line+i;
+    if (l->track==track)
+    {
+      *hit=1;
+      l->used=++c->clock;
+      return l;
+    }
+    if (l->used<lru->used) lru=l;
+  }
+  *hit=0;
+  l=lru;
+  if (l->data==(char*)0)
+  {
+    l->data=malloc(c->trackBytes);
+    l->valid=malloc(this->sectrk);
+    l->dirty=malloc(this->sectrk);
+    l->lsector=malloc(this->sectrk*sizeof(int));
+    if (l->data==(char*)0 || l->valid==(char*)0 || l->dirty==(char*)0 || l->lsector==(int*)0)
+    {
+      free(l->data);
+      free(l->valid);
+      free(l->dirty);
+      free(l->lsector);
+      l->data=(char*)0;
+      l->valid=(char*)0;
+      l->dirty=(char*)0;
+      l->lsector=(int*)0;
+      *err="out of memory";
+      return (struct trackCacheLine*)0;
+    }
+  }
+  else if ((*err=flushLine(this,l))) return (struct trackCacheLine*)0;
+  l->track=track;
+  l->used=++c->clock;
+  l->dirtyCount=0;
+  memset(l->valid,0,this->sectrk);
+  memset(l->dirty,0,this->sectrk);
+  return l;
+}
+
+/*
+================================================================================
+ Cache_readSector      -- read a physical sector through the cache
+
+ Reads with flags set (system tracks, fsed.cpm) bypass the cache.
+================================================================================
+*/
+const char *Cache_readSector(const struct Device *this, int track, int sector, int lsector, int flags, char *buf)
+{
+  struct trackCache *c=this->cache;
+  struct trackCacheLine *l;
+  const char *err;
+  int hit,i,s=sector-this->datasect;
+
+  if (c==(struct trackCache*)0 || flags || s<0 || s>=this->sectrk)
+     return Device_readSector(this,track,sector,lsector,flags,buf);
+
+  if ((l=getLine(this,track,&hit,&err))==(struct trackCacheLine*)0) return err;
+  if (!l->valid[s])
+  {
+    ++stats.misses;
+    if ((err=Device_readTrack(this,track,c->scratch))) return err;
+    ++stats.trackReads;
+    /* keep sectors written since the line was filled */
+    for (i=0; i<this->sectrk; ++i) if (!l->dirty[i])
+    {
+      memcpy(l->data+i*this->secLength,c->scratch+i*this->secLength,this->secLength);
+      l->valid[i]=1;
+    }
+  }
+  else ++stats.hits;
+  memcpy(buf,l->data+s*this->secLength,this->secLength);
+  return (const char*)0;
+}
+
+/*
+================================================================================
+ Cache_writeSector     -- write a physical sector into the cache
+================================================================================
+*/
+const char *Cache_writeSector(const struct Device *this, int track, int sector, int lsector, int flags, const char *buf)
+{
+  struct trackCacheLine *l;
+  const char *err;
+  int hit,s=sector-this->datasect;
+
+  if (this->cache==(struct trackCache*)0 || flags || s<0 || s>=this->sectrk)
+     return Device_writeSector(this,track,sector,lsector,flags,buf);
+
+  if ((l=getLine(this,track,&hit,&err))==(struct trackCacheLine*)0) return err;
+  if (hit) ++stats.hits; else ++stats.misses;
+  memcpy(l->data+s*this->secLength,buf,this->secLength);
+  l->valid[s]=1;
+  l->lsector[s]=lsector;
+  if (!l->dirty[s])
+  {
+    l->dirty[s]=1;
+    ++l->dirtyCount;
+  }
+  return (const char*)0;
+}
+
+/*
+================================================================================
+ Cache_flush           -- write all dirty tracks back
+================================================================================
+*/
+const char *Cache_flush(const struct Device *this)
+{
+  struct trackCache *c=this->cache;
+  const char *err;
+  int i;
+
+  if (!this->opened || c==(struct trackCache*)0) return (const char*)0;
+  for (i=0; i<c->lines; ++i)
+     if ((err=flushLine(this,c->line+i))) return err;
+  return (const char*)0;
+}
+
+/*
+================================================================================
+ Cache_close           -- flush and free the cache
+================================================================================
+*/
+const char *Cache_close(struct Device *this)
+{
+  struct trackCache *c=this->cache;
+  const char *err;
+  int i;
+
+  if (c==(struct trackCache*)0) return (const char*)0;
+  err=Cache_flush(this);
+  for (i=0; i<c->lines; ++i)
+  {
+    free(c->line[i].data);
+    free(c->line[i].valid);
+    free(c->line[i].dirty);
+    free(c->line[i].lsector);
+  }
+  free(c->line);
+  free(c->scratch);
+  free(c);
+  this->cache=(struct trackCache*)0;
+  return err;
+}
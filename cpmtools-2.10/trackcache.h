@@ -0,0 +1,59 @@
+#ifndef TRACKCACHE_H
+#define TRACKCACHE_H
+
+/*
+================================================================================
+ Track cache between cpmfs.c and the device drivers.
+
+ readBlock() and writeBlock() used to call the device once per sector. The
+ cache holds whole tracks instead: a read miss fetches the complete track
+ with Device_readTrack(), writes are kept in the cache and written back
+ when a track is evicted, on cpmSync() and on Device_close().
+
+ The number of tracks held is taken from the CPMTOOLS_CACHE environment
+ variable (default CACHE_TRACKS, 0 turns the cache off).  If
+ CPMTOOLS_CACHE_STATS is set the hit and miss counters are reported on
+ stderr when the program exits, since not every tool closes the device.
+================================================================================
+*/
+
+#define CACHE_TRACKS 16
+
+struct Device;
+
+struct trackCacheLine
+{
+  int track;            /* track held, -1 if the line is free */
+  unsigned long used;   /* LRU time stamp */
+  int dirtyCount;       /* number of dirty sectors */
+  char *data;           /* sectrk * secLength bytes */
+  char *valid;          /* per sector: data holds the sector */
+  char *dirty;          /* per sector: data is newer than the device */
+  int *lsector;         /* per sector: logical sector it was written as */
+};
+
+struct trackCache
+{
+  int lines;
+  int trackBytes;
+  unsigned long clock;
+  char *scratch;        /* track buffer for read misses */
+  struct trackCacheLine *line;
+};
+
+struct trackCacheStats
+{
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long trackReads;
+  unsigned long trackWrites;
+  unsigned long sectorWrites;
+};
+
+void Cache_open(struct Device *this);
+const char *Cache_readSector(const struct Device *this, int track, int sector, int lsector, int flags, char *buf);
+const char *Cache_writeSector(const struct Device *this, int track, int sector, int lsector, int flags, const char *buf);
+const char *Cache_flush(const struct Device *this);
+const char *Cache_close(struct Device *this);
+
+#endif
@@ -0,0 +1,31 @@
+-- Copyright 2022 UnderM4hz
+-- Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+-- to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+-- and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+-- THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+-- FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+-- WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+--
+-- Feel free to give credit
+
+-- Boot time in mame, for make boot-time
+--
+-- Run with -autoboot_script. Prints the emulated time from reset to the
+-- first frame that ends with the cpu in the resident program, then quits.
+-- The boot rom runs from 0x8000 up and boot_bee.s from 0x7e00, so neither
+-- is in that range. Checking once a frame makes it good to 20 ms.
+
+local PROGRAM_START = 0x0100            -- gsinit_start in crt0_bee.s
+local PROGRAM_END = 0x6000              -- overlays and data from here
+
+local cpu = manager.machine.devices[":maincpu"]
+
+boot_time_notifier = emu.add_machine_frame_notifier( function()
+
+    local pc = cpu.state["PC"].value
+
+    if pc >= PROGRAM_START and pc < PROGRAM_END then
+        print( string.format( "Reset to the demo: %.0f ms", manager.machine.time:as_double() * 1000 ) )
+        manager.machine:exit()
+    end
+end )
@@ -0,0 +1,267 @@
+// Copyright 2022 UnderM4hz
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// Feel free to give credit
+
+// Two channel music converter for the player in sound_bee.s
+//
+// Reads a text score and writes it as a C array in the player's format.
+// A score is made of lines, a word starting with # starts a comment:
+//
+//     speed 6             frames per row
+//     rows 8              rows per pattern
+//     pattern verse       rows until end, two notes a row
+//     C4  E2
+//     --  ..
+//     end
+//     order verse verse   patterns in the order they play, then from the top
+//
+// A note is a name, sharp or flat and octave from C2 to A6 (C4, F#3, Bb5),
+// -- holds the note playing and .. turns the channel off. A pattern with
+// fewer rows is padded with holds.
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define MAX_PATTERNS 64
+#define MAX_ROWS 64
+#define MAX_ORDERS 255                  // Count is a byte in the song header
+#define MAX_NAME 32
+
+#define NOTE_HOLD 0
+#define NOTE_OFF 1
+#define NOTE_FIRST 2                    // C2
+#define NOTE_LAST ( NOTE_FIRST + 57 )   // A6
+
+typedef struct Pattern {
+
+    char name[MAX_NAME];
+    int rows;
+    uint8_t notes[MAX_ROWS][2];
+} Pattern;
+
+static Pattern patterns[MAX_PATTERNS];
+static int pattern_count;
+static int orders[MAX_ORDERS];
+static int order_count;
+static int speed = 6;
+static int rows = 0;
+
+static const char *filename;
+static int line_number;
+
+static void fail( const char *message, const char *token ) {
+
+    fprintf( stderr, "%s:%d: %s %s\n", filename, line_number, message, token ? token : "" );
+    exit( 1 );
+}
+
+///< Note token to the player's note number
+static int note_parse( const char *token ) {
+
+    static const int semitones[] = { 9, 11, 0, 2, 4, 5, 7 };  // A to G
+    const char *s = token;
+    int note;
+
+    if ( !strcmp( token, "--" ) )
+        return NOTE_HOLD;
+    if ( !strcmp( token, ".." ) )
+        return NOTE_OFF;
+
+    char letter = toupper( (unsigned char)*s++ );
+    if ( letter < 'A' || letter > 'G' )
+        fail( "bad note", token );
+    note = semitones[letter - 'A'];
+
+    if ( *s == '#' ) {
+        note++;
+        s++;
+    }
+    else if ( *s == 'b' ) {
+        note--;
+        s++;
+    }
+
+    if ( !isdigit( (unsigned char)*s ) || s[1] )
+        fail( "bad note", token );
+    note += ( *s - '0' - 2 ) * 12 + NOTE_FIRST;
+
+    if ( note < NOTE_FIRST || note > NOTE_LAST )
+        fail( "note out of range C2 to A6", token );
+
+    return note;
+}
+
+static int pattern_find( const char *name ) {
+
+    for( int i = 0; i < pattern_count; i++ )
+        if ( !strcmp( patterns[i].name, name ) )
+            return i;
+    return -1;
+}
+
+static void score_load( FILE *fp ) {
+
+    char line[256];
+    Pattern *pattern = 0;
+
+    while( fgets( line, sizeof( line ), fp ) ) {
+
+        char *token[MAX_ORDERS + 1];
+        int count = 0;
+
+        line_number++;
+
+        // # starts a comment at the start of a word, inside one it's a sharp
+        for( char *t = strtok( line, " \t\r\n" ); t && *t != '#' && count <= MAX_ORDERS; t = strtok( 0, " \t\r\n" ) )
+            token[count++] = t;
+        if ( !count )
+            continue;
+
+        if ( pattern ) {
+
+            if ( !strcmp( token[0], "end" ) ) {
+                pattern = 0;
+                continue;
+            }
+            if ( count != 2 )
+                fail( "a row is two notes", 0 );
+            if ( pattern->rows == MAX_ROWS )
+                fail( "too many rows in", pattern->name );
+            pattern->notes[pattern->rows][0] = note_parse( token[0] );
+            pattern->notes[pattern->rows][1] = note_parse( token[1] );
+            pattern->rows++;
+        }
+        else if ( !strcmp( token[0], "speed" ) && count == 2 ) {
+            speed = atoi( token[1] );
+            if ( speed < 1 || speed > 255 )
+                fail( "speed is 1 to 255", 0 );
+        }
+        else if ( !strcmp( token[0], "rows" ) && count == 2 ) {
+            rows = atoi( token[1] );
+            if ( rows < 1 || rows > MAX_ROWS )
+                fail( "rows is 1 to", "64" );
+        }
+        else if ( !strcmp( token[0], "pattern" ) && count == 2 ) {
+            if ( pattern_find( token[1] ) >= 0 )
+                fail( "pattern defined twice", token[1] );
+            if ( pattern_count == MAX_PATTERNS || strlen( token[1] ) >= MAX_NAME )
+                fail( "too many patterns at", token[1] );
+            pattern = &patterns[pattern_count++];
+            strcpy( pattern->name, token[1] );
+        }
+        else if ( !strcmp( token[0], "order" ) ) {
+            for( int i = 1; i < count; i++ ) {
+                if ( order_count == MAX_ORDERS )
+                    fail( "order list too long", 0 );
+                if ( ( orders[order_count++] = pattern_find( token[i] ) ) < 0 )
+                    fail( "no pattern", token[i] );
+            }
+        }
+        else
+            fail( "unknown", token[0] );
+    }
+
+    if ( pattern )
+        fail( "no end to pattern", pattern->name );
+    if ( !order_count )
+        fail( "no order list", 0 );
+}
+
+///< Write the song as a C array in the player's format
+static void song_write( FILE *fp, const char *name ) {
+
+    int longest = 0;
+
+    for( int i = 0; i < pattern_count; i++ )
+        if ( patterns[i].rows > longest )
+            longest = patterns[i].rows;
+    if ( !rows )
+        rows = longest;
+    if ( longest > rows )
+        fail( "a pattern is longer than rows", 0 );
+
+    int base = 3 + order_count * 2;
+    int size = base + pattern_count * rows * 2;
+    if ( size > 0xffff )
+        fail( "song too big", 0 );
+
+    fprintf( fp, "// Generated by beemusic from %s, %d bytes\n\n", filename, size );
+    fprintf( fp, "const unsigned char %s[] = {\n\n", name );
+    fprintf( fp, "    %d, %d, %d,\n", speed, rows, order_count );
+
+    fprintf( fp, "    // Orders\n   " );
+    for( int i = 0; i < order_count; i++ ) {
+        int offset = base + orders[i] * rows * 2;
+        fprintf( fp, " 0x%02x, 0x%02x,", offset & 0xff, offset >> 8 );
+    }
+    fprintf( fp, "\n" );
+
+    for( int i = 0; i < pattern_count; i++ ) {
+
+        fprintf( fp, "    // %s\n   ", patterns[i].name );
+        for( int row = 0; row < rows; row++ ) {
+            if ( row < patterns[i].rows )
+                fprintf( fp, " %d, %d,", patterns[i].notes[row][0], patterns[i].notes[row][1] );
+            else
+                fprintf( fp, " %d, %d,", NOTE_HOLD, NOTE_HOLD );
+        }
+        fprintf( fp, "\n" );
+    }
+    fprintf( fp, "};\n" );
+}
+
+static void usage( const char *cmd ) {
+
+    fprintf( stderr, "Usage: %s [-n name] score.txt song.c\n", cmd );
+    fprintf( stderr, " -n    name of the array (default song)\n" );
+    exit( 1 );
+}
+
+int main( int argc, char **argv ) {
+
+    const char *name = "song";
+    int c;
+
+    while( ( c = getopt( argc, argv, "n:" ) ) != -1 ) {
+
+        switch( c ) {
+        case 'n':
+            name = optarg;
+            break;
+        default:
+            usage( argv[0] );
+        }
+    }
+    if ( optind != argc - 2 )
+        usage( argv[0] );
+
+    filename = argv[optind];
+    FILE *fp = fopen( filename, "r" );
+    if ( !fp ) {
+        perror( filename );
+        return 1;
+    }
+    score_load( fp );
+    fclose( fp );
+
+    fp = fopen( argv[optind + 1], "w" );
+    if ( !fp ) {
+        perror( argv[optind + 1] );
+        return 1;
+    }
+    song_write( fp, name );
+    fclose( fp );
+
+    return 0;
+}
@@ -0,0 +1,150 @@
+// Copyright 2022 UnderM4hz
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// Feel free to give credit
+
+// Display mode registers for vdu_crt_setup() in microbee.c
+//
+// Holds the 6545 register sets of the display modes, checks each one and
+// writes the registers of the mode the build picks as a C header, with the
+// tile ram offset of each row. At 64 columns microbee.c finds a row with a
+// shift, the row table is for column counts that are not a power of two.
+//
+// Every mode keeps the 108 character line of the 64x16 mode and 313 lines
+// a frame, so the frame is the same 67608 T-states at 50 Hz whatever the
+// mode. Only the rows, the lines in a row and the sync positions change.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TILE_RAM_SIZE 0x800
+#define LINE_CHARS 108                  // 216 T-states a line
+#define FRAME_LINES 313                 // 50 Hz
+#define ROW_LINES_MAX 16                // A pcg glyph
+#define REGISTERS 16
+
+///< A display mode, registers 0-15 of the 6545
+typedef struct Mode {
+
+    const char *name;
+    uint8_t registers[REGISTERS];
+} Mode;
+
+// Registers: horizontal total, displayed and sync position, sync widths,
+// vertical total rows, line adjust, displayed rows and sync row, mode
+// control, lines a row less 1, cursor start (off) and end, display start
+// and cursor position
+static const Mode modes[] = {
+
+    { "64X16", { 108 - 1, 64, 81, 0x37, 19 - 1, 9, 16, 17, 72, 16 - 1, 0x20 + 15, 15, 0, 0, 0, 0 } },
+    { "80X24", { 108 - 1, 80, 88, 0x37, 28 - 1, 5, 24, 26, 72, 11 - 1, 0x20 + 10, 10, 0, 0, 0, 0 } },
+    { "40X25", { 108 - 1, 40, 69, 0x37, 28 - 1, 5, 25, 26, 72, 11 - 1, 0x20 + 10, 10, 0, 0, 0, 0 } },
+    { "64X32", { 108 - 1, 64, 81, 0x37, 39 - 1, 1, 32, 34, 72, 8 - 1, 0x20 + 7, 7, 0, 0, 0, 0 } },
+};
+
+#define MODES ( sizeof( modes ) / sizeof( modes[0] ) )
+
+static void fail( const Mode *mode, const char *message ) {
+
+    fprintf( stderr, "beecrt: %s: %s\n", mode->name, message );
+    exit( 1 );
+}
+
+///< Check a mode keeps the frame timing and fits the tile ram
+static void mode_check( const Mode *mode ) {
+
+    const uint8_t *r = mode->registers;
+    int columns = r[1], rows = r[6], row_lines = r[9] + 1;
+    int lines = ( r[4] + 1 ) * row_lines + r[5];
+
+    if ( r[0] + 1 != LINE_CHARS )
+        fail( mode, "line is not 108 characters" );
+    if ( r[2] <= columns || r[2] + ( r[3] & 0x0f ) > LINE_CHARS )
+        fail( mode, "horizontal sync not between the display and the end of the line" );
+    if ( lines != FRAME_LINES )
+        fail( mode, "frame is not 313 lines" );
+    if ( r[7] < rows || r[7] > r[4] )
+        fail( mode, "vertical sync not between the display and the end of the frame" );
+    if ( row_lines > ROW_LINES_MAX )
+        fail( mode, "rows taller than a glyph" );
+    if ( columns * rows > TILE_RAM_SIZE )
+        fail( mode, "more tiles than tile ram" );
+}
+
+static void usage( const char *cmd ) {
+
+    fprintf( stderr, "Usage: %s [-m mode] crt_modes.h\n", cmd );
+    fprintf( stderr, " -m    mode to write, 64X16 (default), 80X24, 40X25 or 64X32\n" );
+    exit( 1 );
+}
+
+int main( int argc, char **argv ) {
+
+    const char *name = "64X16";
+    const Mode *mode = 0;
+    int c;
+
+    while( ( c = getopt( argc, argv, "m:" ) ) != -1 ) {
+
+        switch( c ) {
+        case 'm':
+            name = optarg;
+            break;
+        default:
+            usage( argv[0] );
+        }
+    }
+    if ( optind != argc - 1 )
+        usage( argv[0] );
+
+    // Every set is checked, not just the one written
+    for( unsigned i = 0; i < MODES; i++ ) {
+
+        mode_check( &modes[i] );
+        if ( strcmp( modes[i].name, name ) == 0 )
+            mode = &modes[i];
+    }
+    if ( !mode ) {
+        fprintf( stderr, "beecrt: %s: no such mode\n", name );
+        return 1;
+    }
+
+    FILE *fp = fopen( argv[optind], "w" );
+    if ( !fp ) {
+        perror( argv[optind] );
+        return 1;
+    }
+
+    fprintf( fp, "// Generated by beecrt for %s, checked for 108 characters a line and 313 lines a frame\n\n", mode->name );
+    for( unsigned i = 0; i < MODES; i++ )
+        fprintf( fp, "#define VDU_MODE_%s %u\n", modes[i].name, i );
+    fprintf( fp, "#define VDU_MODE VDU_MODE_%s\n", mode->name );
+    fprintf( fp, "#define VDU_MODE_NAME \"%s\"\n", mode->name );
+    fprintf( fp, "#define VDU_MODE_COLUMNS %d\n", mode->registers[1] );
+    fprintf( fp, "#define VDU_MODE_ROWS %d\n\n", mode->registers[6] );
+
+    // An initialiser rather than a table, so a build that shifts links none of it
+    fprintf( fp, "///< Tile ram offset of each row, for g_vdu_row_offsets[]\n" );
+    fprintf( fp, "#define VDU_MODE_ROW_OFFSETS {" );
+    for( int row = 0; row < mode->registers[6]; row++ )
+        fprintf( fp, "%s%d,", row % 8 ? " " : " \\\n    ", row * mode->registers[1] );
+    fprintf( fp, " }\n\n" );
+
+    fprintf( fp, "///< 6545 registers 0-15, for crt_registers_load()\n" );
+    fprintf( fp, "static const uint8_t g_vdu_mode_registers[%d] = {", REGISTERS );
+    for( int r = 0; r < REGISTERS; r++ )
+        fprintf( fp, " %d,", mode->registers[r] );
+    fprintf( fp, " };\n" );
+
+    fclose( fp );
+
+    return 0;
+}
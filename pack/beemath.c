@@ -0,0 +1,79 @@
+// Copyright 2022 UnderM4hz
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// Feel free to give credit
+
+// Lookup tables for the fixed point routines in fixed_bee.s
+//
+// Writes the tables as raw binary, a 256 byte page each, for beepack to
+// pack. fixed_init() unpacks them to a page boundary, so a routine finds
+// an entry by putting the page in h and the index in l. 16 bit entries
+// have their low bytes in one page and high bytes in the next but one or
+// the next, so the same l reaches both. In order:
+//
+//     0-1  n * n / 4 low bytes, n 0-511, for a * b = q( a + b ) - q( a - b )
+//     2-3  n * n / 4 high bytes
+//     4    65536 / n low bytes, n 2-255, 0 for 0 and 1, which fixed8_div()
+//          never looks up
+//     5    65536 / n high bytes
+//     6    sin as 8.8, 256 steps a turn, low bytes
+//     7    sin high bytes
+//     8    32 * log2( n ), n 1-255
+//     9    atan( 2 ^ ( -n / 32 ) ) in 256ths of a turn, for atan2 from the
+//          difference of two logs
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define PAGES 10
+#define PAGE_SIZE 256
+
+static uint8_t tables[PAGES][PAGE_SIZE];
+
+int main( int argc, char **argv ) {
+
+    if ( argc != 2 ) {
+        fprintf( stderr, "Usage: %s tables.bin\n", argv[0] );
+        return 1;
+    }
+
+    for( int n = 0; n < 512; n++ ) {
+
+        uint16_t square = n * n / 4;
+
+        tables[0 + n / PAGE_SIZE][n % PAGE_SIZE] = square & 0xff;
+        tables[2 + n / PAGE_SIZE][n % PAGE_SIZE] = square >> 8;
+    }
+
+    for( int n = 0; n < PAGE_SIZE; n++ ) {
+
+        // 65536 doesn't fit, fixed8_div() shifts for b = 1 and stops at b = 0
+        uint16_t reciprocal = n < 2 ? 0 : ( 65536 + n / 2 ) / n;
+        int16_t sine = lround( sin( n * 2 * M_PI / 256 ) * 256 );
+        double log = n ? 32 * log2( n ) : 0;
+        double atangent = atan( pow( 2, -n / 32.0 ) ) * 256 / ( 2 * M_PI );
+
+        tables[4][n] = reciprocal & 0xff;
+        tables[5][n] = reciprocal >> 8;
+        tables[6][n] = (uint16_t)sine & 0xff;
+        tables[7][n] = (uint16_t)sine >> 8;
+        tables[8][n] = log > 255 ? 255 : lround( log );
+        tables[9][n] = lround( atangent );
+    }
+
+    FILE *fp = fopen( argv[1], "wb" );
+    if ( !fp ) {
+        perror( argv[1] );
+        return 1;
+    }
+    fwrite( tables, 1, sizeof( tables ), fp );
+    fclose( fp );
+
+    return 0;
+}
@@ -0,0 +1,368 @@
+// Copyright 2022 UnderM4hz
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// Feel free to give credit
+
+// Asset packer for lz_unpack() in lz_bee.s
+//
+// Reads an asset, compresses it and writes it as a C array. The format is
+// byte tokens: 1-127 literal bytes follow, 128-255 copy ( token & 127 ) + 4
+// bytes from a 2 byte offset back, 0 ends. The packing is optimal for the
+// format, found by working back from the end of the input.
+//
+// Assets are raw binary, or text:
+//
+//     -s columns  a screen of tiles, each line is a row of ascii tiles,
+//                 padded with spaces to the columns
+//     -g          pcg glyphs, each line is a row of 8 pixels, # is set,
+//                 16 lines a glyph
+//     -w          a world of tiles for the scrolling tile map, 16 lines of
+//                 any length, padded with spaces to a whole chunk
+//
+// A world is cut into chunks of 16 columns, each stored a column at a time
+// and packed on its own, so a column can be unpacked without the ones
+// before it. It starts with its width in columns and the offset of each
+// chunk from the start, all 2 byte words.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_INPUT 0x10000
+
+#define WORLD_ROWS 16
+#define WORLD_CHUNK_COLUMNS 16
+#define WORLD_COLUMNS_MIN 64            // A screen
+#define WORLD_COLUMNS_MAX 4096
+
+#define LITERAL_MAX 127
+#define MATCH_MIN 4
+#define MATCH_MAX ( 127 + MATCH_MIN )
+#define OFFSET_MAX 0xffff
+
+static uint8_t input[MAX_INPUT + 1];
+static uint8_t output[MAX_INPUT * 2];
+
+///< Best packing from each position to the end
+typedef struct Step {
+
+    uint32_t cost;                      // Packed bytes from here to the end
+    uint16_t length;                    // Literal run or match length from here
+    uint16_t offset;                    // 0 for literals
+} Step;
+
+static Step steps[MAX_INPUT + 1];
+
+static const char *filename;
+
+static char world[WORLD_ROWS][WORLD_COLUMNS_MAX];
+
+static void fail( const char *message ) {
+
+    fprintf( stderr, "%s: %s\n", filename, message );
+    exit( 1 );
+}
+
+///< Read a raw, screen or glyph asset
+static int asset_load( FILE *fp, int columns, int glyphs ) {
+
+    char line[1024];
+    int size = 0;
+
+    if ( !columns && !glyphs ) {
+
+        // One byte over shows the file doesn't fit
+        size = fread( input, 1, MAX_INPUT + 1, fp );
+        if ( size > MAX_INPUT )
+            fail( "too big" );
+        return size;
+    }
+
+    while( fgets( line, sizeof( line ), fp ) ) {
+
+        int length = strcspn( line, "\r\n" );
+
+        if ( glyphs ) {
+
+            uint8_t pixels = 0;
+
+            if ( !length || line[0] == ';' )
+                continue;
+            if ( length != 8 )
+                fail( "a glyph row is 8 pixels" );
+            for( int i = 0; i < 8; i++ )
+                pixels = ( pixels << 1 ) | ( line[i] == '#' );
+            if ( size == MAX_INPUT )
+                fail( "too big" );
+            input[size++] = pixels;
+        }
+        else {
+
+            if ( length > columns )
+                fail( "line longer than the columns" );
+            if ( size + columns > MAX_INPUT )
+                fail( "too big" );
+            memset( input + size, ' ', columns );
+            memcpy( input + size, line, length );
+            size += columns;
+        }
+    }
+
+    if ( glyphs && size % 16 )
+        fail( "a glyph is 16 rows" );
+
+    return size;
+}
+
+///< Read a world, returns its columns
+static int world_load( FILE *fp ) {
+
+    char line[WORLD_COLUMNS_MAX + 2];
+    int rows = 0, columns = 0;
+
+    memset( world, ' ', sizeof( world ) );
+    while( fgets( line, sizeof( line ), fp ) ) {
+
+        int length = strcspn( line, "\r\n" );
+
+        if ( rows == WORLD_ROWS )
+            fail( "a world is 16 rows" );
+        if ( length > WORLD_COLUMNS_MAX )
+            fail( "world too wide" );
+        memcpy( world[rows++], line, length );
+        if ( length > columns )
+            columns = length;
+    }
+
+    if ( rows != WORLD_ROWS )
+        fail( "a world is 16 rows" );
+    if ( columns < WORLD_COLUMNS_MIN )
+        fail( "a world is at least a screen wide" );
+
+    return ( columns + WORLD_CHUNK_COLUMNS - 1 ) / WORLD_CHUNK_COLUMNS * WORLD_CHUNK_COLUMNS;
+}
+
+///< Longest match for position at, returns its length and sets offset
+static int match_find( int size, int at, int *offset ) {
+
+    int best = 0;
+    int start = at > OFFSET_MAX ? at - OFFSET_MAX : 0;
+
+    for( int from = at - 1; from >= start; from-- ) {
+
+        int length = 0;
+        while( at + length < size && length < MATCH_MAX && input[from + length] == input[at + length] )
+            length++;
+        if ( length > best ) {
+            best = length;
+            *offset = at - from;
+            if ( best == MATCH_MAX )
+                break;
+        }
+    }
+
+    return best;
+}
+
+static int pack( int size ) {
+
+    int out = 0;
+
+    steps[size].cost = 1;               // End token
+
+    for( int at = size - 1; at >= 0; at-- ) {
+
+        Step *step = &steps[at];
+        int offset = 0;
+        int longest = match_find( size, at, &offset );
+
+        step->cost = UINT32_MAX;
+
+        for( int length = 1; length <= LITERAL_MAX && at + length <= size; length++ ) {
+            uint32_t cost = 1 + length + steps[at + length].cost;
+            if ( cost < step->cost ) {
+                step->cost = cost;
+                step->length = length;
+                step->offset = 0;
+            }
+        }
+
+        // The nearest longest match also has every shorter length at that offset
+        for( int length = MATCH_MIN; length <= longest; length++ ) {
+            uint32_t cost = 3 + steps[at + length].cost;
+            if ( cost < step->cost ) {
+                step->cost = cost;
+                step->length = length;
+                step->offset = offset;
+            }
+        }
+    }
+
+    for( int at = 0; at < size; at += steps[at].length ) {
+
+        Step *step = &steps[at];
+
+        if ( step->offset ) {
+            output[out++] = 0x80 | ( step->length - MATCH_MIN );
+            output[out++] = step->offset & 0xff;
+            output[out++] = step->offset >> 8;
+        }
+        else {
+            output[out++] = step->length;
+            memcpy( output + out, input + at, step->length );
+            out += step->length;
+        }
+    }
+    output[out++] = 0;
+
+    return out;
+}
+
+///< Unpack again as lz_unpack() does, to check the packing
+static void verify( int size, int packed ) {
+
+    static uint8_t check[MAX_INPUT];
+    int in = 0, out = 0;
+
+    while( output[in] ) {
+
+        int token = output[in++];
+
+        if ( token & 0x80 ) {
+            int length = ( token & 0x7f ) + MATCH_MIN;
+            int offset = output[in] | output[in + 1] << 8;
+            in += 2;
+            for( int i = 0; i < length; i++, out++ )
+                check[out] = check[out - offset];
+        }
+        else {
+            memcpy( check + out, output + in, token );
+            in += token;
+            out += token;
+        }
+    }
+
+    if ( in != packed - 1 || out != size || memcmp( check, input, size ) )
+        fail( "packing does not unpack" );
+}
+
+///< Pack a world a chunk at a time after its header, returns the size
+static int world_pack( int columns, uint8_t *packed ) {
+
+    int chunks = columns / WORLD_CHUNK_COLUMNS;
+    int size = 2 + chunks * 2;
+
+    packed[0] = columns & 0xff;
+    packed[1] = columns >> 8;
+
+    for( int chunk = 0; chunk < chunks; chunk++ ) {
+
+        int length = 0;
+
+        for( int column = 0; column < WORLD_CHUNK_COLUMNS; column++ )
+            for( int row = 0; row < WORLD_ROWS; row++ )
+                input[length++] = world[row][chunk * WORLD_CHUNK_COLUMNS + column];
+
+        int out = pack( length );
+        verify( length, out );
+
+        if ( size + out > MAX_INPUT )
+            fail( "too big" );
+        packed[2 + chunk * 2] = size & 0xff;
+        packed[3 + chunk * 2] = size >> 8;
+        memcpy( packed + size, output, out );
+        size += out;
+    }
+
+    return size;
+}
+
+static void usage( const char *cmd ) {
+
+    fprintf( stderr, "Usage: %s [-n name] [-s columns | -g | -w] asset packed.c\n", cmd );
+    fprintf( stderr, " -n    name of the array (default asset)\n" );
+    fprintf( stderr, " -s    text screen, one row of tiles a line\n" );
+    fprintf( stderr, " -g    text pcg glyphs, # for a set pixel\n" );
+    fprintf( stderr, " -w    text world for the tile map, 16 rows of tiles\n" );
+    exit( 1 );
+}
+
+int main( int argc, char **argv ) {
+
+    const char *name = "asset";
+    int columns = 0, glyphs = 0, worlds = 0;
+    int c;
+
+    while( ( c = getopt( argc, argv, "n:s:gw" ) ) != -1 ) {
+
+        switch( c ) {
+        case 'n':
+            name = optarg;
+            break;
+        case 's':
+            columns = atoi( optarg );
+            if ( columns < 1 )
+                usage( argv[0] );
+            break;
+        case 'g':
+            glyphs = 1;
+            break;
+        case 'w':
+            worlds = 1;
+            break;
+        default:
+            usage( argv[0] );
+        }
+    }
+    if ( optind != argc - 2 || ( columns != 0 ) + glyphs + worlds > 1 )
+        usage( argv[0] );
+
+    filename = argv[optind];
+    FILE *fp = fopen( filename, columns || glyphs || worlds ? "r" : "rb" );
+    if ( !fp ) {
+        perror( filename );
+        return 1;
+    }
+
+    int size, packed;
+
+    if ( worlds ) {
+
+        static uint8_t world_packed[MAX_INPUT];
+
+        columns = world_load( fp );
+        size = columns * WORLD_ROWS;
+        packed = world_pack( columns, world_packed );
+        memcpy( output, world_packed, packed );
+    }
+    else {
+
+        size = asset_load( fp, columns, glyphs );
+        packed = pack( size );
+        verify( size, packed );
+    }
+    fclose( fp );
+
+    fp = fopen( argv[optind + 1], "w" );
+    if ( !fp ) {
+        perror( argv[optind + 1] );
+        return 1;
+    }
+    fprintf( fp, "// Generated by beepack from %s, %d bytes packed to %d\n\n", filename, size, packed );
+    fprintf( fp, "const unsigned char %s[] = {\n", name );
+    for( int i = 0; i < packed; i++ )
+        fprintf( fp, "%s0x%02x,%s", i % 16 ? " " : "    ", output[i], i % 16 == 15 || i == packed - 1 ? "\n" : "" );
+    fprintf( fp, "};\n" );
+    fclose( fp );
+
+    printf( "%s: %d bytes packed to %d (%d%%)\n", filename, size, packed, size ? packed * 100 / size : 0 );
+
+    return 0;
+}
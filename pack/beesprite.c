@@ -0,0 +1,269 @@
+// Copyright 2022 UnderM4hz
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// Feel free to give credit
+
+// Sprite pre-shifter for sprite_compose() in sprite_bee.s
+//
+// Reads 8x16 sprite images and writes each one shifted right by 0 to 7
+// pixels as a C array, so the demo never shifts a pixel. A shift is the
+// two tile columns the sprite covers, left then right, each 16 rows of a
+// keep byte and a set byte, drawn on the background as
+//
+//     ( background & keep ) | set
+//
+// which is 64 bytes a shift and 512 an image.
+//
+// With -c it writes sdas source instead: a routine for each image and
+// shift that draws it for sprite_compose_code(), and a table of them, 8
+// for each image. A routine stores each row as an immediate, masks only
+// the rows that mix with the background and skips the transparent ones,
+// so it costs what the sprite has in it rather than a fixed 38 T-states
+// a row.
+//
+// Images are text, each line is a row of 8 pixels and 16 lines an image:
+// # is set, + is clear and . or a space shows the background. Lines
+// starting with ; are comments.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define IMAGE_ROWS 16
+#define IMAGE_SHIFTS 8
+#define IMAGE_SIZE ( IMAGE_SHIFTS * 2 * IMAGE_ROWS * 2 )
+#define MAX_ROWS ( IMAGE_ROWS * 256 )
+
+static uint8_t set[MAX_ROWS];           // Pixels drawn set
+static uint8_t opaque[MAX_ROWS];        // Pixels drawn, set or clear
+
+static const char *filename;
+
+static void fail( const char *message ) {
+
+    fprintf( stderr, "%s: %s\n", filename, message );
+    exit( 1 );
+}
+
+///< Read the images, returns the rows
+static int images_load( FILE *fp ) {
+
+    char line[1024];
+    int rows = 0;
+
+    while( fgets( line, sizeof( line ), fp ) ) {
+
+        int length = strcspn( line, "\r\n" );
+        uint8_t pixels = 0, mask = 0;
+
+        if ( !length || line[0] == ';' )
+            continue;
+        if ( length > 8 )
+            fail( "a sprite row is 8 pixels" );
+        if ( rows == MAX_ROWS )
+            fail( "too many images" );
+
+        for( int i = 0; i < 8; i++ ) {
+
+            char c = i < length ? line[i] : ' ';
+
+            if ( c != '#' && c != '+' && c != '.' && c != ' ' )
+                fail( "pixels are #, +, . or space" );
+            pixels = ( pixels << 1 ) | ( c == '#' );
+            mask = ( mask << 1 ) | ( c == '#' || c == '+' );
+        }
+        set[rows] = pixels;
+        opaque[rows++] = mask;
+    }
+
+    if ( rows % IMAGE_ROWS )
+        fail( "an image is 16 rows" );
+
+    return rows;
+}
+
+///< Keep and set bytes of a row shifted right, in column 0 or 1
+static void shift_row( int row, int shift, int column, uint8_t *keep, uint8_t *pixels ) {
+
+    uint16_t shifted = ( set[row] << 8 ) >> shift;
+    uint16_t mask = ( opaque[row] << 8 ) >> shift;
+
+    *keep = ~( column ? mask : mask >> 8 );
+    *pixels = column ? shifted : shifted >> 8;
+}
+
+///< Write the images pre-shifted as a C array
+static void data_write( FILE *fp, const char *name, int images ) {
+
+    fprintf( fp, "// Generated by beesprite from %s, %d images of %d bytes\n\n", filename, images, IMAGE_SIZE );
+    fprintf( fp, "const unsigned char %s[] = {\n", name );
+    for( int image = 0; image < images; image++ ) {
+
+        for( int shift = 0; shift < IMAGE_SHIFTS; shift++ ) {
+
+            fprintf( fp, "    // image %d shift %d\n", image, shift );
+            for( int column = 0; column < 2; column++ ) {
+
+                for( int row = 0; row < IMAGE_ROWS; row++ ) {
+
+                    uint8_t keep, pixels;
+
+                    shift_row( image * IMAGE_ROWS + row, shift, column, &keep, &pixels );
+                    fprintf( fp, "%s0x%02x, 0x%02x,", row % 8 ? " " : "    ", keep, pixels );
+                    if ( row % 8 == 7 )
+                        fprintf( fp, "\n" );
+                }
+            }
+        }
+    }
+    fprintf( fp, "};\n" );
+}
+
+///< Write a routine for each image and shift as sdas source, returns their total T-states
+static long code_write( FILE *fp, const char *name, int images ) {
+
+    long total = 0;
+
+    fprintf( fp, ";;; Generated by beesprite from %s, %d images\n", filename, images );
+    fprintf( fp, ";;;\n;;; Routines for sprite_compose_code(), entered with hl at the sprite's\n" );
+    fprintf( fp, ";;; first row in its 64 byte aligned glyphs. Costs include the ret.\n\n" );
+    fprintf( fp, "    .module %s\n    .globl  _%s\n\n    .area   _CODE\n\n", name, name );
+
+    fprintf( fp, "_%s:\n", name );
+    for( int image = 0; image < images; image++ )
+        for( int shift = 0; shift < IMAGE_SHIFTS; shift++ )
+            fprintf( fp, "    .dw     %s_%d_%d\n", name, image, shift );
+
+    for( int image = 0; image < images; image++ ) {
+
+        for( int shift = 0; shift < IMAGE_SHIFTS; shift++ ) {
+
+            char body[8192];
+            int length = 0;
+            int at = 0;
+            long tstates = 10;
+
+            for( int column = 0; column < 2; column++ ) {
+
+                for( int row = 0; row < IMAGE_ROWS; row++ ) {
+
+                    int offset = column * IMAGE_ROWS * 2 + row;
+                    int step = offset - at;
+                    uint8_t keep, pixels;
+
+                    shift_row( image * IMAGE_ROWS + row, shift, column, &keep, &pixels );
+                    if ( keep == 0xff )
+                        continue;
+
+                    // Only l moves, the glyphs don't cross a 256 byte page
+                    if ( step <= 3 ) {
+
+                        for( int i = 0; i < step; i++ )
+                            length += sprintf( body + length, "    inc     l\n" );
+                        tstates += step * 4;
+                    }
+                    else {
+
+                        length += sprintf( body + length, "    ld      a, l\n    add     a, #%d\n    ld      l, a\n", step );
+                        tstates += 15;
+                    }
+                    at = offset;
+
+                    if ( !keep ) {
+
+                        length += sprintf( body + length, "    ld      (hl), #0x%02x\n", pixels );
+                        tstates += 10;
+                    }
+                    else {
+
+                        length += sprintf( body + length, "    ld      a, (hl)\n    and     a, #0x%02x\n", keep );
+                        tstates += 14;
+                        if ( pixels ) {
+
+                            length += sprintf( body + length, "    or      a, #0x%02x\n", pixels );
+                            tstates += 7;
+                        }
+                        length += sprintf( body + length, "    ld      (hl), a\n" );
+                        tstates += 7;
+                    }
+                }
+            }
+
+            fprintf( fp, "\n;;; image %d shift %d, %ld T-states\n%s_%d_%d:\n%s    ret\n", image, shift, tstates, name, image, shift, body );
+            total += tstates;
+        }
+    }
+
+    return total;
+}
+
+static void usage( const char *cmd ) {
+
+    fprintf( stderr, "Usage: %s [-n name] [-c] sprites.txt sprites.c|sprites.s\n", cmd );
+    fprintf( stderr, " -n    name of the array or table (default sprites)\n" );
+    fprintf( stderr, " -c    compiled routines as sdas source, rather than data\n" );
+    exit( 1 );
+}
+
+int main( int argc, char **argv ) {
+
+    const char *name = "sprites";
+    int code = 0;
+    int c;
+
+    while( ( c = getopt( argc, argv, "n:c" ) ) != -1 ) {
+
+        switch( c ) {
+        case 'n':
+            name = optarg;
+            break;
+        case 'c':
+            code = 1;
+            break;
+        default:
+            usage( argv[0] );
+        }
+    }
+    if ( optind != argc - 2 )
+        usage( argv[0] );
+
+    filename = argv[optind];
+    FILE *fp = fopen( filename, "r" );
+    if ( !fp ) {
+        perror( filename );
+        return 1;
+    }
+    int rows = images_load( fp );
+    fclose( fp );
+
+    int images = rows / IMAGE_ROWS;
+
+    fp = fopen( argv[optind + 1], "w" );
+    if ( !fp ) {
+        perror( argv[optind + 1] );
+        return 1;
+    }
+
+    if ( code ) {
+
+        long total = code_write( fp, name, images );
+        fclose( fp );
+        printf( "%s: %d images compiled, %ld T-states a shift on average\n", filename, images,
+                images ? total / ( images * IMAGE_SHIFTS ) : 0 );
+        return 0;
+    }
+
+    data_write( fp, name, images );
+    fclose( fp );
+
+    printf( "%s: %d images, %d bytes\n", filename, images, images * IMAGE_SIZE );
+
+    return 0;
+}
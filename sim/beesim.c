@@ -0,0 +1,869 @@
+// Copyright 2022 UnderM4hz
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// Feel free to give credit
+
+// Headless Microbee for timing the demo without a display
+//
+// Loads a CP/M .com at 0x100 and emulates just the hardware the demo uses:
+// the 6545 crt controller (including the keyboard scan through the light
+// pen and update registers), the vdu bank port, the sound port, the
+// video memory at 0xF000/0xF800, the 128K memory map port and the pio port
+// b bit 7 vsync interrupt. Keys are
+// pressed from the command line at given frames. The bdos can read files
+// from the directory of the .com, for overlays.
+//
+// With the sdcc map file every instruction is charged to the function it
+// is in, giving exact T-states per function. Budgets make it usable in a
+// build: the exit status is 2 if any call of a function takes longer.
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "z80.h"
+
+#define COM_ADDRESS 0x100
+#define BDOS_ADDRESS 0xE000             // Top of the tpa, as seen at 0x0006
+#define SCREEN_ADDRESS 0xF000
+#define PCG_ADDRESS 0xF800
+#define BANK_SIZE 0x8000                // Port 0x50 maps a 32K block to 0x0000-0x7FFF
+
+#define CPU_CYCLES_PER_CHAR 2           // 3.375MHz cpu, 1.6875MHz character clock
+
+#define MAX_KEYS 64
+#define MAX_SYMBOLS 4096
+#define MAX_DEPTH 1024
+#define MAX_BUDGETS 64
+#define RECORD_SIZE 128                 // Cp/m file record
+
+// Same names as the demo
+enum {
+
+    crtStatusVSync = 5,
+    crtStatusLightPen,
+    crtStatusUpdateReady,
+};
+
+enum {
+
+    crtHorizontalTotalChars = 0,
+    crtHorizontalDisplayedChars = 1,
+    crtVerticalTotalRows = 4,
+    crtVerticalTotalLineAdjust = 5,
+    crtVerticalDisplayedRows = 6,
+    crtRowScanLines = 9,
+    crtDisplayStartAddressHigh = 12,
+    crtDisplayStartAddressLow = 13,
+    crtLightPenHigh = 16,
+    crtLightPenLow = 17,
+    crtUpdateAddressHigh = 18,
+    crtUpdateAddressLow = 19,
+    crtUpdateStrobe = 31,
+};
+
+///< A key held down for a number of frames
+typedef struct {
+
+    int key;                            // Matrix position 0-63
+    unsigned long start;
+    unsigned long count;
+} KeyPress;
+
+///< Function from the map file
+typedef struct {
+
+    char *name;
+    uint16_t address;
+    uint64_t self;                      // T-states spent in the function itself
+    uint64_t inclusive;                 // T-states from entry to return
+    uint64_t max;                       // Longest single call
+    uint64_t calls;
+    int active;                         // Calls of it on the call stack
+} Symbol;
+
+///< Call in progress
+typedef struct {
+
+    int symbol;
+    uint16_t sp;                        // Stack pointer holding the return address
+    uint64_t start;
+} Frame;
+
+typedef struct {
+
+    char *name;
+    uint64_t limit;
+} Budget;
+
+typedef struct {
+
+    Z80 cpu;
+
+    uint8_t ram[0x10000];
+    uint8_t colour[0x800];              // Colour ram, switched in at 0xF800 by port 0x08
+    uint8_t blocks[2][BANK_SIZE];       // Blocks 2 and 3 of a 128K machine, ram is blocks 0 and 1
+    int ram_kb;                         // 32, 64 or 128
+    uint8_t map;                        // Memory map port, block in bits 0-1
+
+    uint8_t pio_vector;                 // Port b interrupt vector
+    uint8_t pio_control;                // Last interrupt control word, bit 7 enables
+    uint8_t pio_mask;                   // 0 bits are watched
+    uint8_t pio_mask_next;              // The next control write is the mask
+    uint8_t pio_pending;                // Vsync interrupt not yet taken
+    int vblank;                         // Last in_vblank(), for its edge
+
+    uint8_t vdu_bank;
+    uint8_t latch_rom;
+    uint8_t sound;
+    uint64_t speaker_edges;
+
+    uint8_t crt_select;
+    uint8_t crt[32];
+    uint16_t update_address;
+    uint16_t light_pen;
+    uint8_t light_pen_full;
+
+    uint64_t frame_start;
+    unsigned long frame;
+
+    uint8_t key_down[MAX_KEYS];
+    KeyPress presses[MAX_KEYS];
+    int press_count;
+
+    Symbol symbols[MAX_SYMBOLS];
+    int symbol_count;
+    int16_t owner[0x10000];             // Symbol each address belongs to, -1 for none
+    Frame stack[MAX_DEPTH];
+    int depth;
+    uint64_t unknown;                   // T-states outside any known function
+
+    char directory[FILENAME_MAX];       // Of the .com, where the bdos opens files
+    uint16_t dma;
+
+    const char *stop;
+} Machine;
+
+static Machine bee;
+
+///< Line and frame lengths from the crt registers
+static uint64_t line_cycles( Machine *m ) {
+
+    return ( m->crt[crtHorizontalTotalChars] + 1 ) * CPU_CYCLES_PER_CHAR;
+}
+
+static uint64_t frame_cycles( Machine *m ) {
+
+    uint64_t lines = ( m->crt[crtVerticalTotalRows] + 1 ) * ( m->crt[crtRowScanLines] + 1 ) +
+                     m->crt[crtVerticalTotalLineAdjust];
+    return lines * line_cycles( m );
+}
+
+static int in_vblank( Machine *m ) {
+
+    uint64_t line = ( m->cpu.cycles - m->frame_start ) / line_cycles( m );
+    return line >= (uint64_t)m->crt[crtVerticalDisplayedRows] * ( m->crt[crtRowScanLines] + 1 );
+}
+
+///< Update strobe, the keyboard is wired to update address bits 4-9
+static void crt_update_strobe( Machine *m ) {
+
+    int key = ( m->update_address >> 4 ) & 0x3f;
+
+    if ( m->key_down[key] && !m->light_pen_full ) {
+
+        m->light_pen = m->update_address;
+        m->light_pen_full = 1;
+    }
+    m->update_address = ( m->update_address + 1 ) & 0x3fff;
+}
+
+///< The display refresh also scans the keyboard unless the latch rom is on
+static void crt_refresh_scan( Machine *m ) {
+
+    if ( m->latch_rom || m->light_pen_full )
+        return;
+
+    for( int key = 0; key < MAX_KEYS; key++ ) {
+
+        if ( m->key_down[key] ) {
+
+            m->light_pen = key << 4;
+            m->light_pen_full = 1;
+            return;
+        }
+    }
+}
+
+///< Lower 32K block switched in by the memory map port, 0 for main ram
+static uint8_t *bank_block( Machine *m, uint16_t address ) {
+
+    if ( address >= BANK_SIZE || !( m->map & 3 ) )
+        return 0;
+    if ( !( m->map & 2 ) )
+        return m->ram + BANK_SIZE;      // Block 1, the upper 32K
+    return m->blocks[m->map & 1];
+}
+
+///< A 32K machine has nothing between the ram and the video memory
+static int ram_missing( Machine *m, uint16_t address ) {
+
+    return m->ram_kb == 32 && address >= BANK_SIZE && address < SCREEN_ADDRESS;
+}
+
+static uint8_t mem_read( void *ctx, uint16_t address ) {
+
+    Machine *m = ctx;
+    uint8_t *block = bank_block( m, address );
+
+    if ( block )
+        return block[address];
+    if ( ram_missing( m, address ) )
+        return 0xff;
+
+    if ( address >= PCG_ADDRESS && ( m->vdu_bank & 0x40 ) )
+        return m->colour[address - PCG_ADDRESS];
+    // No character rom image, the latch rom reads as blank
+    if ( address >= SCREEN_ADDRESS && address < PCG_ADDRESS && m->latch_rom )
+        return 0;
+    return m->ram[address];
+}
+
+static void mem_write( void *ctx, uint16_t address, uint8_t value ) {
+
+    Machine *m = ctx;
+    uint8_t *block = bank_block( m, address );
+
+    if ( block )
+        block[address] = value;
+    else if ( ram_missing( m, address ) )
+        return;
+    else if ( address >= PCG_ADDRESS && ( m->vdu_bank & 0x40 ) )
+        m->colour[address - PCG_ADDRESS] = value;
+    else
+        m->ram[address] = value;
+}
+
+static uint8_t io_read( void *ctx, uint16_t port ) {
+
+    Machine *m = ctx;
+
+    switch( port & 0xff ) {
+    case 0x02:
+        // Port b bit 7 follows vertical blanking
+        return ( m->sound & 0x7f ) | ( in_vblank( m ) ? 0x80 : 0 );
+    case 0x0c:
+        return ( 1 << crtStatusUpdateReady ) |
+               ( m->light_pen_full ? 1 << crtStatusLightPen : 0 ) |
+               ( in_vblank( m ) ? 1 << crtStatusVSync : 0 );
+    case 0x0d:
+        switch( m->crt_select ) {
+        case crtLightPenHigh:
+            m->light_pen_full = 0;
+            return ( m->light_pen >> 8 ) & 0x3f;
+        case crtLightPenLow:
+            m->light_pen_full = 0;
+            return m->light_pen & 0xff;
+        case crtUpdateStrobe:
+            crt_update_strobe( m );
+            return 0xff;
+        case 14:
+        case 15:
+            return m->crt[m->crt_select];
+        default:
+            return 0;
+        }
+    default:
+        return 0xff;
+    }
+}
+
+static void io_write( void *ctx, uint16_t port, uint8_t value ) {
+
+    Machine *m = ctx;
+
+    switch( port & 0xff ) {
+    case 0x02:
+        if ( ( m->sound ^ value ) & 0x40 )
+            m->speaker_edges++;
+        m->sound = value;
+        break;
+    case 0x03:
+        // Only the interrupt words, the mode and directions stay as the rom set them
+        if ( m->pio_mask_next ) {
+            m->pio_mask = value;
+            m->pio_mask_next = 0;
+        }
+        else if ( !( value & 1 ) )
+            m->pio_vector = value;
+        else if ( ( value & 0x0f ) == 0x07 ) {
+            m->pio_control = value;
+            m->pio_mask_next = ( value & 0x10 ) != 0;
+        }
+        else if ( ( value & 0x0f ) == 0x03 )
+            m->pio_control = ( m->pio_control & 0x7f ) | ( value & 0x80 );
+        break;
+    case 0x08:
+        m->vdu_bank = value;
+        break;
+    case 0x0b:
+        m->latch_rom = value & 1;
+        break;
+    case 0x50:
+        if ( m->ram_kb == 128 )
+            m->map = value;
+        break;
+    case 0x0c:
+        m->crt_select = value & 0x1f;
+        break;
+    case 0x0d:
+        switch( m->crt_select ) {
+        case crtUpdateAddressHigh:
+            m->update_address = ( ( value & 0x3f ) << 8 ) | ( m->update_address & 0xff );
+            break;
+        case crtUpdateAddressLow:
+            m->update_address = ( m->update_address & 0x3f00 ) | value;
+            break;
+        case crtUpdateStrobe:
+            crt_update_strobe( m );
+            break;
+        default:
+            m->crt[m->crt_select] = value;
+            break;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+///< Open the host file an fcb names, lower case in the directory of the .com
+static FILE *fcb_open( Machine *m, uint16_t fcb ) {
+
+    char name[13], path[FILENAME_MAX + 13];
+    int length = 0;
+
+    for( int i = 1; i <= 11; i++ ) {
+
+        char c = m->ram[fcb + i] & 0x7f;
+        if ( i == 9 )
+            name[length++] = '.';
+        if ( c != ' ' )
+            name[length++] = tolower( c );
+    }
+    name[length] = 0;
+    snprintf( path, sizeof( path ), "%s%s", m->directory, name );
+
+    return fopen( path, "rb" );
+}
+
+///< Minimal bdos: console output, exit and reading files
+static void bdos( Machine *m ) {
+
+    Z80 *z = &m->cpu;
+    uint16_t de = ( z->d << 8 ) | z->e;
+
+    z->a = z->h = 0;
+    switch( z->c ) {
+    case 0:
+        m->stop = "bdos exit";
+        return;
+    case 2:
+        putchar( z->e );
+        break;
+    case 6:
+        if ( z->e != 0xff )
+            putchar( z->e );
+        break;
+    case 9:
+        while( m->ram[de] != '$' )
+            putchar( m->ram[de++] );
+        break;
+    case 12:
+        z->a = 0x22;
+        break;
+    case 15: {
+        FILE *fp = fcb_open( m, de );
+        if ( !fp ) {
+            z->a = 0xff;
+            break;
+        }
+        fclose( fp );
+        m->ram[de + 12] = m->ram[de + 32] = 0; // Extent and record
+        break;
+    }
+    case 20: {
+        // Sequential, the record is extent * 128 + current record
+        uint8_t record[RECORD_SIZE];
+        long at = ( m->ram[de + 12] * 128 + m->ram[de + 32] ) * (long)RECORD_SIZE;
+        FILE *fp = fcb_open( m, de );
+        size_t size = 0;
+        memset( record, 0x1a, sizeof( record ) );
+        if ( fp ) {
+            if ( !fseek( fp, at, SEEK_SET ) )
+                size = fread( record, 1, sizeof( record ), fp );
+            fclose( fp );
+        }
+        if ( !size ) {
+            z->a = 1;                   // End of file
+            break;
+        }
+        for( int i = 0; i < RECORD_SIZE; i++ )
+            m->ram[(uint16_t)( m->dma + i )] = record[i];
+        if ( ++m->ram[de + 32] == 128 ) {
+            m->ram[de + 32] = 0;
+            m->ram[de + 12]++;
+        }
+        break;
+    }
+    case 26:
+        m->dma = de;
+        break;
+    default:
+        break;
+    }
+    z->b = z->h;
+    z->l = z->a;
+    z->pc = mem_read( m, z->sp ) | ( mem_read( m, z->sp + 1 ) << 8 );
+    z->sp += 2;
+}
+
+///< Read symbols from an sdcc .map or .noi file
+static int map_load( Machine *m, const char *filename ) {
+
+    FILE *fp = fopen( filename, "r" );
+    char line[512];
+
+    if ( !fp )
+        return -1;
+
+    while( fgets( line, sizeof( line ), fp ) && m->symbol_count < MAX_SYMBOLS ) {
+
+        char first[128], second[128], third[128];
+        unsigned long address;
+        char *end;
+        const char *name;
+        int fields = sscanf( line, "%127s %127s %127s", first, second, third );
+
+        // .noi: "DEF _main 0x1A3"
+        if ( fields >= 3 && strcmp( first, "DEF" ) == 0 ) {
+            name = second;
+            address = strtoul( third, &end, 16 );
+        }
+        // .map: "     00000180  _vdu_reg_set     microbee"
+        else if ( fields >= 2 && strlen( first ) >= 4 && strlen( first ) <= 8 ) {
+            name = second;
+            address = strtoul( first, &end, 16 );
+        }
+        else
+            continue;
+
+        if ( *end || address > 0xffff )
+            continue;
+        if ( !( isalpha( (unsigned char)name[0] ) || name[0] == '_' ) )
+            continue;
+        // Area start and length symbols
+        if ( strncmp( name, "s__", 3 ) == 0 || strncmp( name, "l__", 3 ) == 0 )
+            continue;
+
+        Symbol *s = &m->symbols[m->symbol_count++];
+        memset( s, 0, sizeof( Symbol ) );
+        s->name = strdup( name );
+        s->address = address;
+    }
+    fclose( fp );
+    return 0;
+}
+
+static int symbol_address_compare( const void *a, const void *b ) {
+
+    return ( (const Symbol*)a )->address - ( (const Symbol*)b )->address;
+}
+
+///< Sort the symbols and work out which one each address belongs to
+static void map_index( Machine *m ) {
+
+    int count = 0;
+
+    qsort( m->symbols, m->symbol_count, sizeof( Symbol ), symbol_address_compare );
+
+    // Keep the first name at an address
+    for( int i = 0; i < m->symbol_count; i++ ) {
+
+        if ( count && m->symbols[count - 1].address == m->symbols[i].address )
+            free( m->symbols[i].name );
+        else
+            m->symbols[count++] = m->symbols[i];
+    }
+    m->symbol_count = count;
+
+    for( int address = 0, i = -1; address < 0x10000; address++ ) {
+
+        while( i + 1 < count && m->symbols[i + 1].address <= address )
+            i++;
+        m->owner[address] = i;
+    }
+}
+
+static int symbol_find( Machine *m, const char *name ) {
+
+    for( int i = 0; i < m->symbol_count; i++ ) {
+
+        const char *s = m->symbols[i].name;
+        if ( strcmp( s, name ) == 0 || ( s[0] == '_' && strcmp( s + 1, name ) == 0 ) )
+            return i;
+    }
+    return -1;
+}
+
+static void call_enter( Machine *m, int symbol ) {
+
+    if ( symbol < 0 || m->depth == MAX_DEPTH )
+        return;
+
+    Frame *f = &m->stack[m->depth++];
+    f->symbol = symbol;
+    f->sp = m->cpu.sp;
+    f->start = m->cpu.cycles;
+    m->symbols[symbol].active++;
+}
+
+static void call_leave( Machine *m ) {
+
+    Frame *f = &m->stack[--m->depth];
+    Symbol *s = &m->symbols[f->symbol];
+    uint64_t t = m->cpu.cycles - f->start;
+
+    // Recursive calls are already inside the outer call
+    if ( --s->active == 0 )
+        s->inclusive += t;
+    if ( t > s->max )
+        s->max = t;
+    s->calls++;
+}
+
+///< Key name: a character from the key top, a matrix number or a named key
+static int key_parse( const char *s ) {
+
+    static const char *names[] = {
+        "esc", "bs", "tab", "lf", "cr", "lock", "break", "space",
+        "up", "ctrl", "down", "left", "", "", "right", "shift",
+    };
+    static const char *punctuation = "@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^\x7f" "0123456789:;,-./";
+
+    for( int i = 0; i < 16; i++ )
+        if ( names[i][0] && strcmp( s, names[i] ) == 0 )
+            return 48 + i;
+
+    if ( s[0] && !s[1] ) {
+        const char *p = strchr( punctuation, toupper( (unsigned char)s[0] ) );
+        if ( p && *p )
+            return p - punctuation;
+        if ( s[0] == ' ' )
+            return 55;
+    }
+
+    if ( s[0] == '#' ) {
+        int key = atoi( s + 1 );
+        return key >= 0 && key < MAX_KEYS ? key : -1;
+    }
+    return -1;
+}
+
+///< Bit 7 watched, active high and enabled, so vsync starting interrupts
+static int pio_vsync_enabled( Machine *m ) {
+
+    return ( m->pio_control & 0xa0 ) == 0xa0 && !( m->pio_mask & 0x80 );
+}
+
+///< Start of a frame, apply the key presses for it
+static void frame_begin( Machine *m ) {
+
+    memset( m->key_down, 0, sizeof( m->key_down ) );
+    for( int i = 0; i < m->press_count; i++ ) {
+
+        KeyPress *k = &m->presses[i];
+        if ( m->frame >= k->start && m->frame < k->start + k->count )
+            m->key_down[k->key] = 1;
+    }
+    crt_refresh_scan( m );
+}
+
+static void screen_dump( Machine *m, FILE *fp ) {
+
+    int columns = m->crt[crtHorizontalDisplayedChars];
+    int rows = m->crt[crtVerticalDisplayedRows];
+    int start = ( m->crt[crtDisplayStartAddressHigh] << 8 ) | m->crt[crtDisplayStartAddressLow];
+
+    for( int row = 0; row < rows; row++ ) {
+
+        for( int column = 0; column < columns; column++ ) {
+
+            uint8_t c = m->ram[SCREEN_ADDRESS + ( ( start + row * columns + column ) & 0x7ff )];
+            // Pcg tiles have no character to show
+            fputc( c >= 0x80 ? '#' : isprint( c ) ? c : '.', fp );
+        }
+        fputc( '\n', fp );
+    }
+}
+
+static void usage( const char *cmd ) {
+
+    fprintf( stderr, "Usage: %s [-q] [-f frames] [-t tstates] [-m mapfile] [-k key@frame[+frames]] [-b function=tstates] [-d screenfile] [-r kb] file.com\n", cmd );
+    fprintf( stderr, " -f    stop after this many frames (default 50)\n" );
+    fprintf( stderr, " -t    stop after this many T-states\n" );
+    fprintf( stderr, " -m    sdcc .map or .noi file, for T-states per function\n" );
+    fprintf( stderr, " -k    hold a key down from a frame, for one frame or +frames\n" );
+    fprintf( stderr, "       key is its key top (A, 7, /), #n for matrix position n, or one of\n" );
+    fprintf( stderr, "       esc bs tab lf cr lock break space up ctrl down left right shift\n" );
+    fprintf( stderr, " -b    fail (exit 2) if any single call of function takes longer\n" );
+    fprintf( stderr, " -d    write the screen as text when stopped\n" );
+    fprintf( stderr, " -r    ram size, 32, 64 or 128 (default 128, banked by port 0x50)\n" );
+    fprintf( stderr, " -q    no report\n" );
+    exit( 1 );
+}
+
+int main( int argc, char **argv ) {
+
+    Machine *m = &bee;
+    Z80 *z = &m->cpu;
+    unsigned long frames = 50;
+    uint64_t tstates = 0;
+    const char *mapfile = 0, *screenfile = 0;
+    Budget budgets[MAX_BUDGETS];
+    int budget_count = 0;
+    int quiet = 0, failed = 0;
+    int c;
+
+    m->ram_kb = 128;
+
+    while( ( c = getopt( argc, argv, "qf:t:m:k:b:d:r:" ) ) != -1 ) {
+
+        switch( c ) {
+        case 'q':
+            quiet = 1;
+            break;
+        case 'f':
+            frames = strtoul( optarg, 0, 0 );
+            break;
+        case 't':
+            tstates = strtoull( optarg, 0, 0 );
+            break;
+        case 'm':
+            mapfile = optarg;
+            break;
+        case 'd':
+            screenfile = optarg;
+            break;
+        case 'r':
+            m->ram_kb = atoi( optarg );
+            if ( m->ram_kb != 32 && m->ram_kb != 64 && m->ram_kb != 128 )
+                usage( argv[0] );
+            break;
+        case 'k': {
+            char *at = strrchr( optarg, '@' );
+            char *plus;
+            if ( !at || at == optarg || m->press_count == MAX_KEYS )
+                usage( argv[0] );
+            *at = 0;
+            KeyPress *k = &m->presses[m->press_count++];
+            if ( ( k->key = key_parse( optarg ) ) < 0 ) {
+                fprintf( stderr, "%s: unknown key %s\n", argv[0], optarg );
+                exit( 1 );
+            }
+            k->start = strtoul( at + 1, &plus, 0 );
+            k->count = *plus == '+' ? strtoul( plus + 1, 0, 0 ) : 1;
+            break;
+        }
+        case 'b': {
+            char *equals = strchr( optarg, '=' );
+            if ( !equals || budget_count == MAX_BUDGETS )
+                usage( argv[0] );
+            *equals = 0;
+            budgets[budget_count].name = optarg;
+            budgets[budget_count++].limit = strtoull( equals + 1, 0, 0 );
+            break;
+        }
+        default:
+            usage( argv[0] );
+        }
+    }
+    if ( optind != argc - 1 )
+        usage( argv[0] );
+
+    // Load the program like cp/m does
+    FILE *fp = fopen( argv[optind], "rb" );
+    if ( !fp ) {
+        perror( argv[optind] );
+        return 1;
+    }
+    size_t size = fread( m->ram + COM_ADDRESS, 1, BDOS_ADDRESS - COM_ADDRESS + 1, fp );
+    fclose( fp );
+    if ( size > BDOS_ADDRESS - COM_ADDRESS ) {
+        fprintf( stderr, "%s: %s does not fit below 0x%04x\n", argv[0], argv[optind], BDOS_ADDRESS );
+        return 1;
+    }
+    const char *slash = strrchr( argv[optind], '/' );
+    if ( slash )
+        snprintf( m->directory, sizeof( m->directory ), "%.*s", (int)( slash - argv[optind] + 1 ), argv[optind] );
+    m->dma = 0x0080;
+
+    m->ram[0x0000] = 0xc3;              // jp warm boot
+    m->ram[0x0005] = 0xc3;              // jp bdos
+    m->ram[0x0006] = BDOS_ADDRESS & 0xff;
+    m->ram[0x0007] = BDOS_ADDRESS >> 8;
+
+    if ( mapfile ) {
+        if ( map_load( m, mapfile ) ) {
+            perror( mapfile );
+            return 1;
+        }
+    }
+    map_index( m );
+
+    for( int i = 0; i < budget_count; i++ ) {
+        if ( symbol_find( m, budgets[i].name ) < 0 ) {
+            fprintf( stderr, "%s: budget for unknown function %s\n", argv[0], budgets[i].name );
+            return 1;
+        }
+    }
+
+    // The 64x16 setup the demo uses, as left by the boot rom
+    static const uint8_t crt_boot[16] = { 107, 64, 81, 55, 18, 9, 16, 17, 72, 15, 0x2f, 15, 0, 0, 0, 0 };
+    memcpy( m->crt, crt_boot, sizeof( crt_boot ) );
+
+    z->ctx = m;
+    z->read = mem_read;
+    z->write = mem_write;
+    z->in = io_read;
+    z->out = io_write;
+    z80_reset( z );
+    z->pc = COM_ADDRESS;
+    z->sp = BDOS_ADDRESS;
+    z->sp -= 2;                         // return to warm boot
+    m->ram[z->sp] = m->ram[z->sp + 1] = 0;
+
+    frame_begin( m );
+
+    while( !m->stop ) {
+
+        if ( z->pc == 0x0000 ) {
+            m->stop = "warm boot";
+            break;
+        }
+        if ( z->pc == 0x0005 ) {
+            bdos( m );
+            continue;
+        }
+        // Only vsync raises interrupts, a halt without it is the end
+        if ( z->halted && !( z->iff1 && pio_vsync_enabled( m ) ) ) {
+            m->stop = "halt";
+            break;
+        }
+
+        int vblank = in_vblank( m );
+        if ( vblank && !m->vblank && pio_vsync_enabled( m ) )
+            m->pio_pending = 1;
+        m->vblank = vblank;
+        if ( m->pio_pending ) {
+            int t = z80_irq( z, m->pio_vector );
+            if ( t ) {
+                m->pio_pending = 0;
+                call_enter( m, m->owner[z->pc] );
+                if ( m->owner[z->pc] >= 0 )
+                    m->symbols[m->owner[z->pc]].self += t;
+                else
+                    m->unknown += t;
+            }
+        }
+
+        uint16_t pc = z->pc, sp = z->sp;
+        uint8_t op = mem_read( m, pc );
+        int t = z80_step( z );
+
+        if ( m->owner[pc] >= 0 )
+            m->symbols[m->owner[pc]].self += t;
+        else
+            m->unknown += t;
+
+        // call, call cc or rst that was taken
+        if ( ( op == 0xcd || ( op & 0xc7 ) == 0xc4 || ( op & 0xc7 ) == 0xc7 ) && z->sp == (uint16_t)( sp - 2 ) ) {
+
+            uint16_t ret = mem_read( m, z->sp ) | ( mem_read( m, z->sp + 1 ) << 8 );
+            if ( ret == (uint16_t)( pc + ( op == 0xcd || ( op & 0xc7 ) == 0xc4 ? 3 : 1 ) ) )
+                call_enter( m, m->owner[z->pc] );
+        }
+        // Returned once the return address is popped
+        while( m->depth && z->sp > m->stack[m->depth - 1].sp )
+            call_leave( m );
+
+        while( z->cycles - m->frame_start >= frame_cycles( m ) ) {
+
+            m->frame_start += frame_cycles( m );
+            m->frame++;
+            frame_begin( m );
+        }
+        if ( m->frame >= frames )
+            m->stop = "frame limit";
+        if ( tstates && z->cycles >= tstates )
+            m->stop = "T-state limit";
+    }
+
+    // Calls still running are charged up to now
+    while( m->depth )
+        call_leave( m );
+
+    if ( screenfile ) {
+        if ( !( fp = fopen( screenfile, "w" ) ) ) {
+            perror( screenfile );
+            return 1;
+        }
+        screen_dump( m, fp );
+        fclose( fp );
+    }
+
+    if ( !quiet ) {
+
+        unsigned long whole = m->frame ? m->frame : 1;
+
+        printf( "stopped: %s after %lu frames, %llu T-states (%llu per frame)\n", m->stop, m->frame,
+                (unsigned long long)z->cycles, (unsigned long long)frame_cycles( m ) );
+        printf( "speaker edges: %llu\n", (unsigned long long)m->speaker_edges );
+
+        if ( m->symbol_count ) {
+
+            printf( "\n%-32s %10s %14s %14s %12s %12s\n", "function", "calls", "self T", "total T", "max call T", "T/frame" );
+            for( int i = 0; i < m->symbol_count; i++ ) {
+
+                Symbol *s = &m->symbols[i];
+                if ( !s->self && !s->calls )
+                    continue;
+                printf( "%-32s %10llu %14llu %14llu %12llu %12llu\n", s->name, (unsigned long long)s->calls,
+                        (unsigned long long)s->self, (unsigned long long)s->inclusive,
+                        (unsigned long long)s->max, (unsigned long long)( s->inclusive / whole ) );
+            }
+            if ( m->unknown )
+                printf( "%-32s %10s %14llu\n", "(no symbol)", "", (unsigned long long)m->unknown );
+        }
+    }
+
+    for( int i = 0; i < budget_count; i++ ) {
+
+        Symbol *s = &m->symbols[symbol_find( m, budgets[i].name )];
+        if ( s->max > budgets[i].limit ) {
+            fprintf( stderr, "%s: %s took %llu T-states, budget %llu\n", argv[0], s->name,
+                     (unsigned long long)s->max, (unsigned long long)budgets[i].limit );
+            failed = 1;
+        }
+    }
+
+    return failed ? 2 : 0;
+}
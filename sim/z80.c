@@ -0,0 +1,852 @@
+// Copyright 2022 UnderM4hz
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// Feel free to give credit
+
+// Z80 instruction set, including the undocumented index register halves,
+// sll and the ddcb register copies. Timing is the documented T-state count
+// of each instruction, the Microbee has no memory contention to add.
+//
+// Opcodes are decoded by field as described in "Decoding Z80 Opcodes"
+// http://www.z80.info/decoding.htm
+//  x = op >> 6, y = ( op >> 3 ) & 7, z = op & 7, p = y >> 1, q = y & 1
+
+#include <string.h>
+
+#include "z80.h"
+
+#define FC z80FlagC
+#define FN z80FlagN
+#define FP z80FlagP
+#define FX z80FlagX
+#define FH z80FlagH
+#define FY z80FlagY
+#define FZ z80FlagZ
+#define FS z80FlagS
+
+// Index register in use after a dd or fd prefix
+enum { idxHL = 0, idxIX = 1, idxIY = 2 };
+
+static uint8_t sz53[256];               // Sign, zero and undocumented bits of a result
+static uint8_t sz53p[256];              // As above plus parity
+static int tables_ready;
+
+static void tables_init() {
+
+    for( int i = 0; i < 256; i++ ) {
+
+        int parity = 0;
+        for( int bit = 0; bit < 8; bit++ )
+            parity ^= ( i >> bit ) & 1;
+
+        sz53[i] = ( i & ( FS | FX | FY ) ) | ( i ? 0 : FZ );
+        sz53p[i] = sz53[i] | ( parity ? 0 : FP );
+    }
+    tables_ready = 1;
+}
+
+static inline uint8_t rd( Z80 *z, uint16_t address ) {
+
+    return z->read( z->ctx, address );
+}
+
+static inline void wr( Z80 *z, uint16_t address, uint8_t value ) {
+
+    z->write( z->ctx, address, value );
+}
+
+static inline uint16_t rd16( Z80 *z, uint16_t address ) {
+
+    return rd( z, address ) | ( rd( z, address + 1 ) << 8 );
+}
+
+static inline void wr16( Z80 *z, uint16_t address, uint16_t value ) {
+
+    wr( z, address, value );
+    wr( z, address + 1, value >> 8 );
+}
+
+///< Opcode fetch, counts as an M1 cycle for the refresh register
+static inline uint8_t fetch_op( Z80 *z ) {
+
+    z->r = ( z->r & 0x80 ) | ( ( z->r + 1 ) & 0x7f );
+    return rd( z, z->pc++ );
+}
+
+static inline uint8_t fetch8( Z80 *z ) {
+
+    return rd( z, z->pc++ );
+}
+
+static inline uint16_t fetch16( Z80 *z ) {
+
+    uint16_t value = rd16( z, z->pc );
+    z->pc += 2;
+    return value;
+}
+
+static inline void push( Z80 *z, uint16_t value ) {
+
+    z->sp -= 2;
+    wr16( z, z->sp, value );
+}
+
+static inline uint16_t pop( Z80 *z ) {
+
+    uint16_t value = rd16( z, z->sp );
+    z->sp += 2;
+    return value;
+}
+
+///< 8 bit register r[n], 6 is (hl) and is handled by the caller
+static uint8_t get_r( Z80 *z, int n, int idx ) {
+
+    switch( n ) {
+    case 0: return z->b;
+    case 1: return z->c;
+    case 2: return z->d;
+    case 3: return z->e;
+    case 4: return idx == idxIX ? z->ix >> 8 : idx == idxIY ? z->iy >> 8 : z->h;
+    case 5: return idx == idxIX ? z->ix & 0xff : idx == idxIY ? z->iy & 0xff : z->l;
+    default: return z->a;
+    }
+}
+
+static void set_r( Z80 *z, int n, int idx, uint8_t value ) {
+
+    switch( n ) {
+    case 0: z->b = value; break;
+    case 1: z->c = value; break;
+    case 2: z->d = value; break;
+    case 3: z->e = value; break;
+    case 4:
+        if ( idx == idxIX ) z->ix = ( z->ix & 0xff ) | ( value << 8 );
+        else if ( idx == idxIY ) z->iy = ( z->iy & 0xff ) | ( value << 8 );
+        else z->h = value;
+        break;
+    case 5:
+        if ( idx == idxIX ) z->ix = ( z->ix & 0xff00 ) | value;
+        else if ( idx == idxIY ) z->iy = ( z->iy & 0xff00 ) | value;
+        else z->l = value;
+        break;
+    default: z->a = value; break;
+    }
+}
+
+///< Register pair rp[n]: bc, de, hl (or ix, iy), sp
+static uint16_t get_rp( Z80 *z, int n, int idx ) {
+
+    switch( n ) {
+    case 0: return ( z->b << 8 ) | z->c;
+    case 1: return ( z->d << 8 ) | z->e;
+    case 2: return idx == idxIX ? z->ix : idx == idxIY ? z->iy : ( z->h << 8 ) | z->l;
+    default: return z->sp;
+    }
+}
+
+static void set_rp( Z80 *z, int n, int idx, uint16_t value ) {
+
+    switch( n ) {
+    case 0: z->b = value >> 8; z->c = value; break;
+    case 1: z->d = value >> 8; z->e = value; break;
+    case 2:
+        if ( idx == idxIX ) z->ix = value;
+        else if ( idx == idxIY ) z->iy = value;
+        else { z->h = value >> 8; z->l = value; }
+        break;
+    default: z->sp = value; break;
+    }
+}
+
+///< Register pair rp2[n]: as rp but af in place of sp
+static uint16_t get_rp2( Z80 *z, int n, int idx ) {
+
+    return n == 3 ? ( z->a << 8 ) | z->f : get_rp( z, n, idx );
+}
+
+static void set_rp2( Z80 *z, int n, int idx, uint16_t value ) {
+
+    if ( n == 3 ) {
+        z->a = value >> 8;
+        z->f = value;
+    }
+    else
+        set_rp( z, n, idx, value );
+}
+
+///< Address of the (hl) operand, (ix+d) and (iy+d) fetch their displacement
+static uint16_t addr_hl( Z80 *z, int idx ) {
+
+    if ( idx == idxHL )
+        return ( z->h << 8 ) | z->l;
+
+    int8_t d = fetch8( z );
+    return ( idx == idxIX ? z->ix : z->iy ) + d;
+}
+
+///< Condition cc[n]: nz, z, nc, c, po, pe, p, m
+static int cond( Z80 *z, int n ) {
+
+    static const uint8_t mask[4] = { FZ, FC, FP, FS };
+    int set = ( z->f & mask[n >> 1] ) != 0;
+    return ( n & 1 ) ? set : !set;
+}
+
+///< alu[n] a, value: add, adc, sub, sbc, and, xor, or, cp
+static void alu( Z80 *z, int n, uint8_t value ) {
+
+    unsigned a = z->a, res, carry;
+
+    switch( n ) {
+    case 0:
+    case 1:
+        carry = n == 1 ? z->f & FC : 0;
+        res = a + value + carry;
+        z->f = sz53[res & 0xff] | ( ( a ^ value ^ res ) & FH ) |
+               ( ( ~( a ^ value ) & ( a ^ res ) & 0x80 ) ? FP : 0 ) | ( ( res >> 8 ) & FC );
+        z->a = res;
+        break;
+    case 2:
+    case 3:
+    case 7:
+        carry = n == 3 ? z->f & FC : 0;
+        res = a - value - carry;
+        z->f = FN | ( ( a ^ value ^ res ) & FH ) |
+               ( ( ( a ^ value ) & ( a ^ res ) & 0x80 ) ? FP : 0 ) | ( ( res >> 8 ) & FC );
+        if ( n == 7 )
+            z->f |= ( sz53[res & 0xff] & ( FS | FZ ) ) | ( value & ( FX | FY ) );
+        else {
+            z->f |= sz53[res & 0xff];
+            z->a = res;
+        }
+        break;
+    case 4:
+        z->a &= value;
+        z->f = sz53p[z->a] | FH;
+        break;
+    case 5:
+        z->a ^= value;
+        z->f = sz53p[z->a];
+        break;
+    default:
+        z->a |= value;
+        z->f = sz53p[z->a];
+        break;
+    }
+}
+
+static uint8_t inc8( Z80 *z, uint8_t value ) {
+
+    uint8_t res = value + 1;
+    z->f = ( z->f & FC ) | sz53[res] | ( ( res & 0x0f ) ? 0 : FH ) | ( res == 0x80 ? FP : 0 );
+    return res;
+}
+
+static uint8_t dec8( Z80 *z, uint8_t value ) {
+
+    uint8_t res = value - 1;
+    z->f = ( z->f & FC ) | FN | sz53[res] | ( ( value & 0x0f ) ? 0 : FH ) | ( value == 0x80 ? FP : 0 );
+    return res;
+}
+
+static uint16_t add16( Z80 *z, uint16_t a, uint16_t value ) {
+
+    uint32_t res = a + value;
+    z->f = ( z->f & ( FS | FZ | FP ) ) | ( ( res >> 8 ) & ( FX | FY ) ) |
+           ( ( ( a ^ value ^ res ) >> 8 ) & FH ) | ( ( res >> 16 ) & FC );
+    return res;
+}
+
+static uint16_t adc16( Z80 *z, uint16_t a, uint16_t value ) {
+
+    uint32_t res = a + value + ( z->f & FC );
+    z->f = ( ( res >> 8 ) & ( FS | FX | FY ) ) | ( ( res & 0xffff ) ? 0 : FZ ) |
+           ( ( ( a ^ value ^ res ) >> 8 ) & FH ) |
+           ( ( ~( a ^ value ) & ( a ^ res ) & 0x8000 ) ? FP : 0 ) | ( ( res >> 16 ) & FC );
+    return res;
+}
+
+static uint16_t sbc16( Z80 *z, uint16_t a, uint16_t value ) {
+
+    uint32_t res = a - value - ( z->f & FC );
+    z->f = FN | ( ( res >> 8 ) & ( FS | FX | FY ) ) | ( ( res & 0xffff ) ? 0 : FZ ) |
+           ( ( ( a ^ value ^ res ) >> 8 ) & FH ) |
+           ( ( ( a ^ value ) & ( a ^ res ) & 0x8000 ) ? FP : 0 ) | ( ( res >> 16 ) & FC );
+    return res;
+}
+
+///< rot[n] value: rlc, rrc, rl, rr, sla, sra, sll, srl
+static uint8_t rot( Z80 *z, int n, uint8_t value ) {
+
+    uint8_t res, carry;
+
+    switch( n ) {
+    case 0: carry = value >> 7; res = ( value << 1 ) | carry; break;
+    case 1: carry = value & 1; res = ( value >> 1 ) | ( carry << 7 ); break;
+    case 2: carry = value >> 7; res = ( value << 1 ) | ( z->f & FC ); break;
+    case 3: carry = value & 1; res = ( value >> 1 ) | ( ( z->f & FC ) << 7 ); break;
+    case 4: carry = value >> 7; res = value << 1; break;
+    case 5: carry = value & 1; res = ( value >> 1 ) | ( value & 0x80 ); break;
+    case 6: carry = value >> 7; res = ( value << 1 ) | 1; break;
+    default: carry = value & 1; res = value >> 1; break;
+    }
+    z->f = sz53p[res] | carry;
+    return res;
+}
+
+static void bit( Z80 *z, int n, uint8_t value ) {
+
+    uint8_t res = value & ( 1 << n );
+    z->f = ( z->f & FC ) | FH | ( res ? 0 : FZ | FP ) | ( res & FS ) | ( value & ( FX | FY ) );
+}
+
+///< Accumulator and flag group, x = 0 z = 7
+static void acc_op( Z80 *z, int y ) {
+
+    uint8_t a = z->a, carry;
+
+    switch( y ) {
+    case 0:                             // rlca
+        z->a = ( a << 1 ) | ( a >> 7 );
+        z->f = ( z->f & ( FS | FZ | FP ) ) | ( z->a & ( FX | FY ) ) | ( a >> 7 );
+        break;
+    case 1:                             // rrca
+        z->a = ( a >> 1 ) | ( a << 7 );
+        z->f = ( z->f & ( FS | FZ | FP ) ) | ( z->a & ( FX | FY ) ) | ( a & 1 );
+        break;
+    case 2:                             // rla
+        z->a = ( a << 1 ) | ( z->f & FC );
+        z->f = ( z->f & ( FS | FZ | FP ) ) | ( z->a & ( FX | FY ) ) | ( a >> 7 );
+        break;
+    case 3:                             // rra
+        z->a = ( a >> 1 ) | ( ( z->f & FC ) << 7 );
+        z->f = ( z->f & ( FS | FZ | FP ) ) | ( z->a & ( FX | FY ) ) | ( a & 1 );
+        break;
+    case 4: {                           // daa
+        uint8_t correct = 0, half;
+        carry = z->f & FC;
+        if ( ( z->f & FH ) || ( a & 0x0f ) > 9 )
+            correct |= 0x06;
+        if ( carry || a > 0x99 ) {
+            correct |= 0x60;
+            carry = FC;
+        }
+        if ( z->f & FN ) {
+            half = ( z->f & FH ) && ( a & 0x0f ) < 6;
+            z->a = a - correct;
+        }
+        else {
+            half = ( a & 0x0f ) > 9;
+            z->a = a + correct;
+        }
+        z->f = sz53p[z->a] | ( z->f & FN ) | carry | ( half ? FH : 0 );
+        break;
+    }
+    case 5:                             // cpl
+        z->a = ~a;
+        z->f = ( z->f & ( FS | FZ | FP | FC ) ) | FH | FN | ( z->a & ( FX | FY ) );
+        break;
+    case 6:                             // scf
+        z->f = ( z->f & ( FS | FZ | FP ) ) | ( a & ( FX | FY ) ) | FC;
+        break;
+    default:                            // ccf
+        z->f = ( ( z->f & ( FS | FZ | FP | FC ) ) | ( ( z->f & FC ) ? FH : 0 ) | ( a & ( FX | FY ) ) ) ^ FC;
+        break;
+    }
+}
+
+///< cb prefixed instructions
+static int exec_cb( Z80 *z ) {
+
+    uint8_t op = fetch_op( z );
+    int x = op >> 6, y = ( op >> 3 ) & 7, n = op & 7;
+    uint16_t address = ( z->h << 8 ) | z->l;
+    uint8_t value = n == 6 ? rd( z, address ) : get_r( z, n, idxHL );
+
+    switch( x ) {
+    case 0: value = rot( z, y, value ); break;
+    case 1: bit( z, y, value ); return n == 6 ? 12 : 8;
+    case 2: value &= ~( 1 << y ); break;
+    default: value |= 1 << y; break;
+    }
+
+    if ( n == 6 ) {
+        wr( z, address, value );
+        return 15;
+    }
+    set_r( z, n, idxHL, value );
+    return 8;
+}
+
+///< dd cb and fd cb prefixed instructions, the prefix is already counted
+static int exec_index_cb( Z80 *z, int idx ) {
+
+    uint16_t address = addr_hl( z, idx );
+    uint8_t op = fetch8( z );
+    int x = op >> 6, y = ( op >> 3 ) & 7, n = op & 7;
+    uint8_t value = rd( z, address );
+
+    switch( x ) {
+    case 0: value = rot( z, y, value ); break;
+    case 1: bit( z, y, value ); return 16;
+    case 2: value &= ~( 1 << y ); break;
+    default: value |= 1 << y; break;
+    }
+
+    wr( z, address, value );
+    // Undocumented: the result is also copied to a register
+    if ( n != 6 )
+        set_r( z, n, idxHL, value );
+    return 19;
+}
+
+///< ldi, cpi, ini, outi and their decrement and repeat forms
+static int exec_block( Z80 *z, int y, int n ) {
+
+    int step = ( y & 1 ) ? -1 : 1;
+    int repeat = y >= 6;
+    uint16_t hl = ( z->h << 8 ) | z->l;
+    uint16_t de = ( z->d << 8 ) | z->e;
+    uint16_t bc = ( z->b << 8 ) | z->c;
+    uint8_t value;
+    int more;
+
+    switch( n ) {
+    case 0: {                           // ldi
+        value = rd( z, hl );
+        wr( z, de, value );
+        hl += step;
+        de += step;
+        bc--;
+        uint8_t sum = value + z->a;
+        z->f = ( z->f & ( FS | FZ | FC ) ) | ( bc ? FP : 0 ) | ( sum & FX ) | ( ( sum << 4 ) & FY );
+        more = bc != 0;
+        break;
+    }
+    case 1: {                           // cpi
+        value = rd( z, hl );
+        uint8_t res = z->a - value;
+        uint8_t half = ( z->a ^ value ^ res ) & FH;
+        uint8_t sum = res - ( half ? 1 : 0 );
+        hl += step;
+        bc--;
+        z->f = ( z->f & FC ) | FN | ( sz53[res] & ( FS | FZ ) ) | half | ( bc ? FP : 0 ) |
+               ( sum & FX ) | ( ( sum << 4 ) & FY );
+        more = bc != 0 && res != 0;
+        break;
+    }
+    case 2:                             // ini
+        value = z->in( z->ctx, bc );
+        wr( z, hl, value );
+        hl += step;
+        bc -= 0x100;
+        z->f = ( sz53[bc >> 8] & ~FP ) | FN;
+        more = ( bc >> 8 ) != 0;
+        break;
+    default:                            // outi
+        value = rd( z, hl );
+        bc -= 0x100;
+        z->out( z->ctx, bc, value );
+        hl += step;
+        z->f = ( sz53[bc >> 8] & ~FP ) | FN;
+        more = ( bc >> 8 ) != 0;
+        break;
+    }
+
+    z->h = hl >> 8; z->l = hl;
+    z->d = de >> 8; z->e = de;
+    z->b = bc >> 8; z->c = bc;
+
+    if ( repeat && more ) {
+        z->pc -= 2;
+        return 21;
+    }
+    return 16;
+}
+
+///< ed prefixed instructions
+static int exec_ed( Z80 *z ) {
+
+    uint8_t op = fetch_op( z );
+    int x = op >> 6, y = ( op >> 3 ) & 7, n = op & 7, p = y >> 1, q = y & 1;
+    uint16_t bc = ( z->b << 8 ) | z->c;
+    uint16_t hl = ( z->h << 8 ) | z->l;
+    uint16_t address;
+    uint8_t value;
+
+    if ( x == 2 && n <= 3 && y >= 4 )
+        return exec_block( z, y, n );
+
+    if ( x != 1 )
+        return 8;
+
+    switch( n ) {
+    case 0:                             // in r,(c)
+        value = z->in( z->ctx, bc );
+        if ( y != 6 )
+            set_r( z, y, idxHL, value );
+        z->f = ( z->f & FC ) | sz53p[value];
+        return 12;
+    case 1:                             // out (c),r
+        z->out( z->ctx, bc, y == 6 ? 0 : get_r( z, y, idxHL ) );
+        return 12;
+    case 2:                             // sbc / adc hl,rr
+        set_rp( z, 2, idxHL, q ? adc16( z, hl, get_rp( z, p, idxHL ) ) : sbc16( z, hl, get_rp( z, p, idxHL ) ) );
+        return 15;
+    case 3:                             // ld (nn),rr / ld rr,(nn)
+        address = fetch16( z );
+        if ( q )
+            set_rp( z, p, idxHL, rd16( z, address ) );
+        else
+            wr16( z, address, get_rp( z, p, idxHL ) );
+        return 20;
+    case 4:                             // neg
+        value = z->a;
+        z->a = 0;
+        alu( z, 2, value );
+        return 8;
+    case 5:                             // retn / reti
+        z->pc = pop( z );
+        z->iff1 = z->iff2;
+        return 14;
+    case 6: {                           // im
+        static const uint8_t mode[8] = { 0, 0, 1, 2, 0, 0, 1, 2 };
+        z->im = mode[y];
+        return 8;
+    }
+    default:
+        switch( y ) {
+        case 0: z->i = z->a; return 9;
+        case 1: z->r = z->a; return 9;
+        case 2:
+        case 3:
+            z->a = y == 2 ? z->i : z->r;
+            z->f = ( z->f & FC ) | sz53[z->a] | ( z->iff2 ? FP : 0 );
+            return 9;
+        case 4:                         // rrd
+            value = rd( z, hl );
+            wr( z, hl, ( z->a << 4 ) | ( value >> 4 ) );
+            z->a = ( z->a & 0xf0 ) | ( value & 0x0f );
+            z->f = ( z->f & FC ) | sz53p[z->a];
+            return 18;
+        case 5:                         // rld
+            value = rd( z, hl );
+            wr( z, hl, ( value << 4 ) | ( z->a & 0x0f ) );
+            z->a = ( z->a & 0xf0 ) | ( value >> 4 );
+            z->f = ( z->f & FC ) | sz53p[z->a];
+            return 18;
+        default:
+            return 8;
+        }
+    }
+}
+
+///< Unprefixed instructions, or dd/fd prefixed with idx set to ix/iy
+///< Index forms return the unprefixed time plus the displacement cost,
+///< the prefix itself is counted by the caller
+static int exec_main( Z80 *z, uint8_t op, int idx ) {
+
+    int x = op >> 6, y = ( op >> 3 ) & 7, n = op & 7, p = y >> 1, q = y & 1;
+    uint16_t address;
+    uint8_t value;
+    int8_t d;
+
+    switch( x ) {
+    case 0:
+        switch( n ) {
+        case 0:
+            switch( y ) {
+            case 0:                     // nop
+                return 4;
+            case 1:                     // ex af,af'
+                value = z->a; z->a = z->a_; z->a_ = value;
+                value = z->f; z->f = z->f_; z->f_ = value;
+                return 4;
+            case 2:                     // djnz
+                d = fetch8( z );
+                if ( --z->b ) {
+                    z->pc += d;
+                    return 13;
+                }
+                return 8;
+            case 3:                     // jr
+                d = fetch8( z );
+                z->pc += d;
+                return 12;
+            default:                    // jr cc
+                d = fetch8( z );
+                if ( cond( z, y - 4 ) ) {
+                    z->pc += d;
+                    return 12;
+                }
+                return 7;
+            }
+        case 1:
+            if ( q ) {                  // add hl,rr
+                set_rp( z, 2, idx, add16( z, get_rp( z, 2, idx ), get_rp( z, p, idx ) ) );
+                return 11;
+            }
+            set_rp( z, p, idx, fetch16( z ) );
+            return 10;
+        case 2:
+            switch( p ) {
+            case 0:
+            case 1:
+                address = get_rp( z, p, idxHL );
+                if ( q )
+                    z->a = rd( z, address );
+                else
+                    wr( z, address, z->a );
+                return 7;
+            case 2:
+                address = fetch16( z );
+                if ( q )
+                    set_rp( z, 2, idx, rd16( z, address ) );
+                else
+                    wr16( z, address, get_rp( z, 2, idx ) );
+                return 16;
+            default:
+                address = fetch16( z );
+                if ( q )
+                    z->a = rd( z, address );
+                else
+                    wr( z, address, z->a );
+                return 13;
+            }
+        case 3:                         // inc / dec rr
+            set_rp( z, p, idx, get_rp( z, p, idx ) + ( q ? -1 : 1 ) );
+            return 6;
+        case 4:
+        case 5:                         // inc / dec r
+            if ( y == 6 ) {
+                address = addr_hl( z, idx );
+                value = rd( z, address );
+                wr( z, address, n == 4 ? inc8( z, value ) : dec8( z, value ) );
+                return idx ? 19 : 11;
+            }
+            value = get_r( z, y, idx );
+            set_r( z, y, idx, n == 4 ? inc8( z, value ) : dec8( z, value ) );
+            return 4;
+        case 6:                         // ld r,n
+            if ( y == 6 ) {
+                address = addr_hl( z, idx );
+                wr( z, address, fetch8( z ) );
+                return idx ? 15 : 10;
+            }
+            set_r( z, y, idx, fetch8( z ) );
+            return 7;
+        default:
+            acc_op( z, y );
+            return 4;
+        }
+
+    case 1:
+        if ( y == 6 && n == 6 ) {       // halt
+            z->halted = 1;
+            return 4;
+        }
+        if ( n == 6 ) {                 // ld r,(hl), r is never an index half
+            address = addr_hl( z, idx );
+            set_r( z, y, idxHL, rd( z, address ) );
+            return idx ? 15 : 7;
+        }
+        if ( y == 6 ) {
+            address = addr_hl( z, idx );
+            wr( z, address, get_r( z, n, idxHL ) );
+            return idx ? 15 : 7;
+        }
+        set_r( z, y, idx, get_r( z, n, idx ) );
+        return 4;
+
+    case 2:
+        if ( n == 6 ) {
+            address = addr_hl( z, idx );
+            alu( z, y, rd( z, address ) );
+            return idx ? 15 : 7;
+        }
+        alu( z, y, get_r( z, n, idx ) );
+        return 4;
+
+    default:
+        switch( n ) {
+        case 0:                         // ret cc
+            if ( cond( z, y ) ) {
+                z->pc = pop( z );
+                return 11;
+            }
+            return 5;
+        case 1:
+            if ( !q ) {                 // pop rr
+                set_rp2( z, p, idx, pop( z ) );
+                return 10;
+            }
+            switch( p ) {
+            case 0:                     // ret
+                z->pc = pop( z );
+                return 10;
+            case 1: {                   // exx
+                uint8_t t;
+                t = z->b; z->b = z->b_; z->b_ = t;
+                t = z->c; z->c = z->c_; z->c_ = t;
+                t = z->d; z->d = z->d_; z->d_ = t;
+                t = z->e; z->e = z->e_; z->e_ = t;
+                t = z->h; z->h = z->h_; z->h_ = t;
+                t = z->l; z->l = z->l_; z->l_ = t;
+                return 4;
+            }
+            case 2:                     // jp (hl)
+                z->pc = get_rp( z, 2, idx );
+                return 4;
+            default:                    // ld sp,hl
+                z->sp = get_rp( z, 2, idx );
+                return 6;
+            }
+        case 2:                         // jp cc,nn
+            address = fetch16( z );
+            if ( cond( z, y ) )
+                z->pc = address;
+            return 10;
+        case 3:
+            switch( y ) {
+            case 0:                     // jp nn
+                z->pc = fetch16( z );
+                return 10;
+            case 2:                     // out (n),a
+                value = fetch8( z );
+                z->out( z->ctx, ( z->a << 8 ) | value, z->a );
+                return 11;
+            case 3:                     // in a,(n)
+                value = fetch8( z );
+                z->a = z->in( z->ctx, ( z->a << 8 ) | value );
+                return 11;
+            case 4: {                   // ex (sp),hl
+                uint16_t t = rd16( z, z->sp );
+                wr16( z, z->sp, get_rp( z, 2, idx ) );
+                set_rp( z, 2, idx, t );
+                return 19;
+            }
+            case 5:                     // ex de,hl, never indexed
+                value = z->d; z->d = z->h; z->h = value;
+                value = z->e; z->e = z->l; z->l = value;
+                return 4;
+            case 6:                     // di
+                z->iff1 = z->iff2 = 0;
+                return 4;
+            default:                    // ei
+                z->iff1 = z->iff2 = 1;
+                z->ei_pending = 1;
+                return 4;
+            }
+        case 4:                         // call cc,nn
+            address = fetch16( z );
+            if ( cond( z, y ) ) {
+                push( z, z->pc );
+                z->pc = address;
+                return 17;
+            }
+            return 10;
+        case 5:
+            if ( !q ) {                 // push rr
+                push( z, get_rp2( z, p, idx ) );
+                return 11;
+            }
+            // call nn, the prefixes never get here
+            address = fetch16( z );
+            push( z, z->pc );
+            z->pc = address;
+            return 17;
+        case 6:                         // alu n
+            alu( z, y, fetch8( z ) );
+            return 7;
+        default:                        // rst
+            push( z, z->pc );
+            z->pc = y * 8;
+            return 11;
+        }
+    }
+}
+
+void z80_reset( Z80 *z ) {
+
+    if ( !tables_ready )
+        tables_init();
+
+    z->a = z->f = z->b = z->c = z->d = z->e = z->h = z->l = 0xff;
+    z->a_ = z->f_ = z->b_ = z->c_ = z->d_ = z->e_ = z->h_ = z->l_ = 0xff;
+    z->ix = z->iy = z->sp = 0xffff;
+    z->pc = 0;
+    z->i = z->r = 0;
+    z->iff1 = z->iff2 = z->im = 0;
+    z->halted = 0;
+    z->ei_pending = 0;
+    z->cycles = 0;
+}
+
+int z80_step( Z80 *z ) {
+
+    int t = 0, idx = idxHL;
+    uint8_t op;
+
+    z->ei_pending = 0;
+
+    if ( z->halted ) {
+        z->r = ( z->r & 0x80 ) | ( ( z->r + 1 ) & 0x7f );
+        z->cycles += 4;
+        return 4;
+    }
+
+    // A run of prefixes costs 4 each, only the last one counts
+    for( ;; ) {
+        op = fetch_op( z );
+        if ( op == 0xdd ) idx = idxIX;
+        else if ( op == 0xfd ) idx = idxIY;
+        else break;
+        t += 4;
+    }
+
+    if ( op == 0xcb )
+        t += idx ? exec_index_cb( z, idx ) : exec_cb( z );
+    else if ( op == 0xed )
+        t += exec_ed( z );
+    else
+        t += exec_main( z, op, idx );
+
+    z->cycles += t;
+    return t;
+}
+
+int z80_irq( Z80 *z, uint8_t data ) {
+
+    int t;
+
+    if ( !z->iff1 || z->ei_pending )
+        return 0;
+
+    z->halted = 0;
+    z->iff1 = z->iff2 = 0;
+    z->r = ( z->r & 0x80 ) | ( ( z->r + 1 ) & 0x7f );
+    push( z, z->pc );
+
+    switch( z->im ) {
+    case 2:
+        z->pc = rd16( z, ( z->i << 8 ) | data );
+        t = 19;
+        break;
+    case 1:
+        z->pc = 0x38;
+        t = 13;
+        break;
+    default:                            // only rst is supported on the bus
+        z->pc = data & 0x38;
+        t = 13;
+        break;
+    }
+
+    z->cycles += t;
+    return t;
+}
@@ -0,0 +1,59 @@
+// Copyright 2022 UnderM4hz
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// Feel free to give credit
+
+#ifndef Z80_H
+#define Z80_H
+
+#include <stdint.h>
+
+///< Flag register bits
+enum {
+
+    z80FlagC = 0x01,                    // Carry
+    z80FlagN = 0x02,                    // Subtract
+    z80FlagP = 0x04,                    // Parity / overflow
+    z80FlagX = 0x08,                    // Undocumented, copy of bit 3
+    z80FlagH = 0x10,                    // Half carry
+    z80FlagY = 0x20,                    // Undocumented, copy of bit 5
+    z80FlagZ = 0x40,                    // Zero
+    z80FlagS = 0x80,                    // Sign
+};
+
+///< Z80 cpu state
+///< Memory and io are reached through the callbacks, ctx is passed back to them
+typedef struct Z80 {
+
+    uint8_t a, f, b, c, d, e, h, l;
+    uint8_t a_, f_, b_, c_, d_, e_, h_, l_;
+    uint16_t ix, iy, sp, pc;
+    uint8_t i, r, iff1, iff2, im;
+    uint8_t halted;
+    uint8_t ei_pending;                 // Interrupts are held off for one instruction after ei
+
+    uint64_t cycles;                    // T-states since reset
+
+    void *ctx;
+    uint8_t (*read)( void *ctx, uint16_t address );
+    void (*write)( void *ctx, uint16_t address, uint8_t value );
+    uint8_t (*in)( void *ctx, uint16_t port );
+    void (*out)( void *ctx, uint16_t port, uint8_t value );
+} Z80;
+
+///< Reset the cpu, the callbacks and ctx are left alone
+void z80_reset( Z80 *z );
+
+///< Execute one instruction, returns the T-states it took
+int z80_step( Z80 *z );
+
+///< Raise a maskable interrupt, data is the byte on the bus (im 0 and 2)
+///< Returns the T-states taken, or 0 if interrupts are disabled
+int z80_irq( Z80 *z, uint8_t data );
+
+#endif
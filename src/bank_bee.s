@@ -0,0 +1,232 @@
+;;; \file bank_bee.s
+;;;
+;;; \brief 128K memory banks, for keeping assets unpacked
+;;;
+;;; \copyright Copyright 2022 UnderM4hz
+;;; Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+;;; to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+;;; and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+;;; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;;; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+;;; WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;;;
+;;; Feel free to give credit
+;;;
+;;; On the 128K premium, port 0x50 picks which of four 32K blocks is at
+;;; 0x0000-0x7fff. The upper 32K is always block 1 and the program runs in
+;;; block 0, which leaves blocks 2 and 3, banks 0 and 1 here.
+;;;
+;;; Switching the lower 32K takes the program and the stack with it, so
+;;; copies run in a stub that bank_init() puts in upper ram, with interrupts
+;;; off. The stub doesn't touch the stack until block 0 is back. One side of
+;;; a copy is the bank, at 0x0000-0x7fff, the other has to be in upper
+;;; memory, such as video ram.
+;;;
+;;; Called from C as __sdcccall(0), see vram_bee.s.
+
+    .module bank
+    .globl  _bank_init
+    .globl  _bank_copy
+
+MAP_PORT = 0x50
+MAP_MAIN = 0x04                         ; block 0, roms off, video ram at 0xF000
+MAP_BANK = MAP_MAIN + 2                 ; bank 0 is block 2
+
+BANK_MAX = 2
+BANK_STUB_ADDRESS = 0x8000
+BANK_SCRATCH = BANK_STUB_ADDRESS + 0x80 ; a byte of upper ram for bank_init()
+BANK_TEST_ADDRESS = 0x0000              ; checked in each bank
+BANK_MARK = 0x5a                        ; written to bank n as BANK_MARK + n
+
+    .area   _DATA
+
+bank_saved:
+    .ds     1                           ; block 0 at BANK_TEST_ADDRESS
+
+    .area   _CODE
+
+;;; uint8_t bank_init()
+;;;
+;;; Find the banks and set the memory map, returns 2 on a 128K machine and
+;;; 0 on 32K and 64K ones. Call once at start up, before anything else uses
+;;; upper memory.
+;;;
+;;; Until a bank is found the port is only written by the probe, to switch
+;;; each bank in and back, and the map is set only once one is there. A 32K
+;;; machine has no ram for the stub, so the port isn't written at all. A
+;;; 64K one ignores the port, so the marks all land in block 0 and read
+;;; back wrong. The stub needs ram at 0x8000 rather than the roms, which
+;;; cp/m and boot_bee.s both set up before the program starts.
+_bank_init:
+    ld      hl, #bank_stub
+    ld      de, #BANK_STUB_ADDRESS
+    ld      bc, #bank_stub_end - bank_stub
+    ldir
+
+    ld      hl, #bank_stub
+    ld      de, #BANK_STUB_ADDRESS
+    ld      b, #bank_stub_end - bank_stub
+00001$:
+    ld      a, (de)
+    cp      a, (hl)
+    jr      nz, 00005$
+    inc     hl
+    inc     de
+    djnz    00001$
+
+    ld      a, (BANK_TEST_ADDRESS)
+    ld      (bank_saved), a
+
+    ; mark each bank with its number
+    xor     a, a
+00002$:
+    ld      b, a
+    add     a, #BANK_MARK
+    ld      (BANK_SCRATCH), a
+    ld      a, b
+    ld      hl, #BANK_SCRATCH
+    ld      de, #BANK_TEST_ADDRESS
+    call    bank_byte
+    inc     a
+    cp      a, #BANK_MAX
+    jr      nz, 00002$
+
+    ; count the banks that read back their own mark
+    xor     a, a
+00003$:
+    ld      hl, #BANK_TEST_ADDRESS
+    ld      de, #BANK_SCRATCH
+    call    bank_byte
+    ld      b, a
+    add     a, #BANK_MARK
+    ld      hl, #BANK_SCRATCH
+    cp      a, (hl)
+    ld      a, b
+    jr      nz, 00004$
+    inc     a
+    cp      a, #BANK_MAX
+    jr      nz, 00003$
+
+00004$:
+    ; no banks if a mark got into block 0
+    ld      c, a                        ; c = banks
+    ld      a, (bank_saved)
+    ld      hl, #BANK_TEST_ADDRESS
+    cp      a, (hl)
+    jr      z, 00006$
+    ld      (hl), a
+00005$:
+    ld      l, #0
+    ret
+
+00006$:
+    ld      l, c
+    inc     c
+    dec     c
+    ret     z
+    ld      a, #MAP_MAIN                ; found one, the map is now ours
+    out     (#MAP_PORT), a
+    ret
+
+;;; Copy a byte from hl to de with bank a in, returns with a and b kept
+bank_byte:
+    push    af
+    push    bc
+    ld      bc, #1
+    call    bank_transfer
+    pop     bc
+    pop     af
+    ret
+
+;;; void bank_copy( uint16_t bank, uint8_t *dest, const uint8_t *src, uint16_t length )
+;;;
+;;; Copy between bank and upper memory, one of dest and src is in the bank
+;;; at 0x0000-0x7fff. Interrupts are held off for the copy and restored.
+;;;
+;;; 16.6 T-states a byte plus 440 set up, a 64x16 page (1024 bytes) is 17440.
+_bank_copy:
+    ld      hl, #2
+    add     hl, sp
+    ld      a, (hl)                     ; a = bank
+    inc     hl
+    inc     hl
+    ld      e, (hl)
+    inc     hl
+    ld      d, (hl)                     ; de = dest
+    inc     hl
+    ld      c, (hl)
+    inc     hl
+    ld      b, (hl)
+    inc     hl
+    push    bc                          ; src
+    ld      c, (hl)
+    inc     hl
+    ld      b, (hl)                     ; bc = length
+    pop     hl                          ; hl = src
+
+    inc     b
+    dec     b
+    jr      nz, bank_transfer
+    inc     c
+    dec     c
+    ret     z
+
+;;; Copy bc bytes, not 0, from hl to de with bank a in, uses a'
+bank_transfer:
+    push    ix
+    add     a, #MAP_BANK
+    ex      af, af'                     ; a' = map port value
+
+    ; the first pass skips ( 16 - length % 16 ) % 16 ldi
+    push    bc
+    ld      a, c
+    neg
+    and     a, #0x0f
+    add     a, a                        ; each ldi is 2 bytes
+    ld      c, a
+    ld      b, #0
+    ld      ix, #BANK_STUB_ADDRESS + bank_stub_block - bank_stub
+    add     ix, bc
+    pop     bc
+
+    ld      a, i                        ; p/v = interrupts enabled
+    jp      pe, 00001$
+    ld      a, i                        ; nmos p/v is 0 if the first took an interrupt
+00001$:
+    push    af
+    di
+    ex      af, af'
+    call    BANK_STUB_ADDRESS
+    pop     af
+    pop     ix
+    ret     po
+    ei
+    ret
+
+;;; Copied to BANK_STUB_ADDRESS, runs with block 0 out
+;;; a = map port value, ix = entry into the ldi block
+bank_stub:
+    out     (#MAP_PORT), a
+    jp      (ix)
+bank_stub_block:
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    jp      pe, BANK_STUB_ADDRESS + bank_stub_block - bank_stub
+    ld      a, #MAP_MAIN
+    out     (#MAP_PORT), a
+    ret
+bank_stub_end:
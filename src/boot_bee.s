@@ -0,0 +1,213 @@
+;;; \file boot_bee.s
+;;;
+;;; \brief System track loader, boots straight into the demo without cp/m
+;;;
+;;; \copyright Copyright 2022 UnderM4hz
+;;; Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+;;; to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+;;; and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+;;; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;;; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+;;; WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;;;
+;;; Feel free to give credit
+;;;
+;;; The boot rom reads sector 1 of track 0 to BOOT_LOAD and runs it. This is
+;;; that sector: it moves itself out of the way, reads the program from the
+;;; sectors after it to PROGRAM_ADDRESS and jumps to gsinit_start.
+;;;
+;;; The program is written to the system tracks by mkfs.cpm -s, after this
+;;; sector and in physical order: side 0 then side 1 of cylinder 0, then
+;;; cylinder 1. The sectors on a system track are not skewed, so a track
+;;; reads in one turn of the disk. BOOT_BYTES and SYSTEM_TRACKS come from
+;;; boot_size.s, which the Makefile writes from the size of microbee.com and
+;;; the ds80 boot tracks, after checking the one fits the other.
+;;;
+;;; At 300 rpm that is 200 ms a track, about 20 ms a sector. Cylinder 0
+;;; starts at sector 2, straight after this one, and side 1 waits half a turn
+;;; on average for its first sector.
+
+    .module boot
+
+    .include "boot_size.s"
+
+BOOT_LOAD = 0x0080                      ; where the boot rom puts sector 1
+BOOT_ADDRESS = 0x7e00                   ; above the program and its data, the stack later
+PROGRAM_ADDRESS = 0x0100                ; gsinit_start in crt0_bee.s
+IM1_VECTOR = 0x0038
+BDOS_ENTRY = 0x0005                     ; jp bdos under cp/m
+
+MAP_PORT = 0x50
+MAP_MAIN = 0x04                         ; block 0, roms off, video ram at 0xF000, as bank_bee.s
+
+SECTOR_SIZE = 512
+SECTORS = 10                            ; a track, numbered from 1 on system tracks
+BOOT_SECTORS = ( BOOT_BYTES + SECTOR_SIZE - 1 ) / SECTOR_SIZE
+BOOT_RETRIES = 4
+
+; Boot rom entry points, as used by the cp/m boot sector
+ROM_RESTART = 0xe000
+ROM_OUTPUT = 0xe00c                     ; character in c
+ROM_PRINT = 0xe033                      ; string at hl, ends with 0x80
+ROM_CLEAR = 0x1a
+
+; wd2793 floppy controller
+FDC_COMMAND_PORT = 0x44                 ; status when read
+FDC_TRACK_PORT = 0x45
+FDC_SECTOR_PORT = 0x46
+FDC_DATA_PORT = 0x47
+FDC_DRIVE_PORT = 0x48                   ; bit 7 is intrq or drq when read
+
+FDC_DRIVE_0 = 0x08                      ; drive 0, double density
+FDC_SIDE_1 = 0x04
+FDC_SEEK = 0x14                         ; with verify, which waits for the head to settle
+FDC_READ_SECTOR = 0x80
+FDC_FORCE_INTERRUPT = 0xd0
+FDC_READ_ERROR = 0x1c                   ; not found, crc error, lost data
+
+    .ifgt   BOOT_SECTORS - ( SYSTEM_TRACKS * SECTORS - 1 )
+    .error  1                           ; program too big for the system tracks
+    .endif
+
+    .area   _HEADER (ABS)
+    .org    BOOT_ADDRESS
+
+boot_start:
+    ; running at BOOT_LOAD until the jump
+    di
+    ld      sp, #BOOT_ADDRESS
+    ld      hl, #BOOT_LOAD
+    ld      de, #BOOT_ADDRESS
+    ld      bc, #boot_end - boot_start
+    ldir
+    jp      00001$
+
+00001$:
+    ; stop anything the rom left running and clear intrq
+    ld      a, #FDC_FORCE_INTERRUPT
+    out     (#FDC_COMMAND_PORT), a
+    ex      (sp), hl
+    ex      (sp), hl
+    in      a, (#FDC_COMMAND_PORT)
+
+    ld      hl, #PROGRAM_ADDRESS
+    ld      de, #0x0002                 ; d = system track, e = sector
+    ld      b, #BOOT_SECTORS
+00002$:
+    push    bc
+    call    boot_read
+    pop     bc
+    inc     e
+    ld      a, e
+    cp      a, #SECTORS + 1
+    jr      nz, 00003$
+    ld      e, #1
+    inc     d
+00003$:
+    djnz    00002$
+
+    ; ei reti for any im 1 interrupt until the program sets up its own
+    ld      hl, #0xedfb
+    ld      (IM1_VECTOR), hl
+    ld      a, #0x4d
+    ld      (IM1_VECTOR + 2), a
+
+    ; no cp/m, so nothing that looks like a jp to the bdos
+    xor     a, a
+    ld      (BDOS_ENTRY), a
+
+    ; roms out and ram at 0x8000, as the cp/m boot leaves it for bank_init()
+    ld      a, #MAP_MAIN
+    out     (#MAP_PORT), a
+    jp      PROGRAM_ADDRESS
+
+;;; Read sector e of system track d to hl and move hl past it
+;;;
+;;; Track d is cylinder d / 2, side d & 1. Bytes come every 108 T-states at
+;;; 250 kbit/s, the read loop takes 50.
+boot_read:
+    ld      a, d
+    and     a, #1
+    add     a, a
+    add     a, a                        ; FDC_SIDE_1
+    or      a, #FDC_DRIVE_0
+    out     (#FDC_DRIVE_PORT), a
+
+    ld      a, d
+    srl     a
+    ld      c, a                        ; c = cylinder
+    in      a, (#FDC_TRACK_PORT)
+    cp      a, c
+    jr      z, 00001$
+    ld      a, c
+    out     (#FDC_DATA_PORT), a
+    ld      a, #FDC_SEEK
+    call    boot_command
+
+00001$:
+    ld      a, #BOOT_RETRIES
+00002$:
+    push    af
+    push    hl
+    ld      a, e
+    out     (#FDC_SECTOR_PORT), a
+    ld      a, #FDC_READ_SECTOR
+    out     (#FDC_COMMAND_PORT), a
+
+    ; two passes of 256, a failed read runs through on intrq and retries
+    ld      bc, #FDC_DATA_PORT          ; b = 0
+00003$:
+    in      a, (#FDC_DRIVE_PORT)
+    add     a, a
+    jr      nc, 00003$
+    ini
+    jr      nz, 00003$
+00004$:
+    in      a, (#FDC_DRIVE_PORT)
+    add     a, a
+    jr      nc, 00004$
+    ini
+    jr      nz, 00004$
+
+    call    boot_wait
+    pop     bc                          ; bc = start of the sector
+    and     a, #FDC_READ_ERROR
+    jr      nz, 00005$
+    pop     af
+    ret
+
+00005$:
+    ld      h, b
+    ld      l, c
+    pop     af
+    dec     a
+    jr      nz, 00002$
+
+    ; give up the same way as the cp/m boot sector
+    ld      c, #ROM_CLEAR
+    call    ROM_OUTPUT
+    ld      hl, #boot_message
+    call    ROM_PRINT
+    jp      ROM_RESTART
+
+;;; Start command a and wait for it, returns the status in a
+boot_command:
+    out     (#FDC_COMMAND_PORT), a
+
+;;; Wait for intrq, returns the status in a
+boot_wait:
+    in      a, (#FDC_DRIVE_PORT)
+    add     a, a
+    jr      nc, boot_wait
+    in      a, (#FDC_COMMAND_PORT)
+    ret
+
+boot_message:
+    .ascii  " Demo unreadable - press RETURN "
+    .db     0x80
+
+boot_end:
+
+    .ifgt   boot_end - boot_start - SECTOR_SIZE
+    .error  1                           ; loader is more than a sector
+    .endif
@@ -14,11 +14,11 @@
     .org     0x100
 
 gsinit_start:
-RAM_ADDRESS = 0x7fff
+RAM_ADDRESS = 0x7ff8           ; Below the im 2 vector table, see im2_bee.s
     ;; Reset vector
     di                         ; disable interrupt
     ld sp, #RAM_ADDRESS        ; Set stack pointer directly above top of memory.
-    im 1                       ; interrupt mode 1 (this won't change)
+    im 1                       ; interrupt mode 1, until im2_init()
 
 clear_ram:
     ;;  for ( int i = size; i < size - 1; i++ )
@@ -0,0 +1,91 @@
+;;; \file crt_bee.s
+;;;
+;;; \brief Load a display mode into the 6545 crt controller
+;;;
+;;; \copyright Copyright 2022 UnderM4hz
+;;; Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+;;; to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+;;; and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+;;; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;;; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+;;; WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;;;
+;;; Feel free to give credit
+;;;
+;;; The 6545 has a register select port and a data port, so a mode can't go
+;;; out with a single otir. Each register is selected with the register
+;;; number in a and written with outi, which steps through the table, so a
+;;; whole mode is one unrolled burst of 31 T-states a register.
+;;;
+;;; The registers of the mode built for come from pack/beecrt, see
+;;; crt_modes.h in the build.
+;;;
+;;; Called from C as __sdcccall(0), see vram_bee.s.
+
+    .module crt
+    .globl  _crt_registers_load
+
+CRT_REGISTER_PORT = 0x0c
+CRT_DATA_PORT = 0x0d
+
+    .area   _CODE
+
+;;; void crt_registers_load( const uint8_t *registers )
+;;;
+;;; Write crt registers 0-15 from a table of 16, leaving register 15
+;;; selected. 572 T-states.
+_crt_registers_load:
+    pop     de
+    pop     hl
+    push    hl
+    push    de
+    ld      c, #CRT_DATA_PORT
+    xor     a, a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    inc     a
+    out     (#CRT_REGISTER_PORT), a
+    outi
+    ret
@@ -0,0 +1,551 @@
+;;; \file fixed_bee.s
+;;;
+;;; \brief Fixed point multiply, divide, sin, cos and atan2 from tables
+;;;
+;;; \copyright Copyright 2022 UnderM4hz
+;;; Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+;;; to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+;;; and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+;;; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;;; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+;;; WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;;;
+;;; Feel free to give credit
+;;;
+;;; Numbers are 8.8 (int16_t, 256 is 1.0) or 16.16 (int32_t), angles are
+;;; 256 to a turn. The tables are made by pack/beemath and unpacked by
+;;; fixed_init() to FIXED_TABLES, on a page boundary in upper ram after the
+;;; tile map's chunk buffer. An entry is found with the page in h and the
+;;; index in l, the high byte of a word entry a page or two up.
+;;;
+;;; Multiplies are built on mul8, 8 x 8 bits from quarter squares:
+;;;
+;;;     a * b = q( a + b ) - q( |a - b| ), q( n ) = n * n / 4
+;;;
+;;; Signed results are worked out on the magnitudes, so they round towards
+;;; 0, and overflow wraps.
+;;;
+;;; Called from C as __sdcccall(0), see vram_bee.s.
+
+    .module fixed
+    .globl  _fixed_init
+    .globl  _fixed_mul8
+    .globl  _fixed8_mul
+    .globl  _fixed8_div
+    .globl  _fixed16_mul
+    .globl  _fixed8_sin
+    .globl  _fixed8_cos
+    .globl  _fixed_atan2
+    .globl  _fixed_tables
+    .globl  _lz_unpack
+
+FIXED_TABLES = 0xb200                   ; 10 pages, up to 0xbbff
+
+; Table pages, in the order pack/beemath writes them
+SQUARE_LO = 0xb2                        ; and 0xb3, n 0-511
+SQUARE_HI = 0xb4                        ; and 0xb5
+RECIPROCAL_LO = 0xb6                    ; 65536 / n
+RECIPROCAL_HI = 0xb7
+SINE_LO = 0xb8                          ; 8.8
+SINE_HI = 0xb9
+LOG2 = 0xba                             ; 32 * log2( n )
+ATAN = 0xbb                             ; atan( 2 ^ ( -n / 32 ) )
+
+QUARTER_TURN = 64
+
+    .area   _DATA
+
+fixed_a:
+    .ds     4                           ; 16.16 operands, a then b
+fixed_b:
+    .ds     4
+fixed_x:
+    .ds     2                           ; mul16 operands
+fixed_y:
+    .ds     2
+fixed_product:
+    .ds     4                           ; mul16 result
+fixed_sum:
+    .ds     4                           ; 16.16 result
+
+    .area   _CODE
+
+;;; void fixed_init()
+;;;
+;;; Unpack the tables, about 64000 T-states. Call once before the rest.
+_fixed_init:
+    ld      hl, #_fixed_tables
+    push    hl
+    ld      hl, #FIXED_TABLES
+    push    hl
+    call    _lz_unpack
+    pop     hl
+    pop     hl
+    ret
+
+;;; uint16_t fixed_mul8( uint16_t a, uint16_t b )
+;;;
+;;; Unsigned 8 x 8 bits to 16 from the low bytes. 207 to 210 T-states.
+_fixed_mul8:
+    ld      hl, #2
+    add     hl, sp
+    ld      a, (hl)
+    inc     hl
+    inc     hl
+    ld      e, (hl)
+    ; falls into mul8
+
+;;; hl = a * e, unsigned
+;;;
+;;; Keeps e, uses a, bc and d. 160 to 163 T-states with the call.
+mul8:
+    ld      b, a
+    add     a, e
+    ld      l, a
+    ld      a, #SQUARE_LO
+    adc     a, #0
+    ld      h, a                        ; hl at q( a + e )
+    ld      a, b
+    sub     a, e
+    jr      nc, 00001$
+    neg
+00001$:
+    ld      c, a
+    ld      b, #SQUARE_LO               ; bc at q( |a - e| )
+    ld      a, (bc)
+    ld      d, a
+    ld      a, (hl)
+    sub     a, d
+    ld      d, a                        ; low byte, inc keeps the borrow
+    inc     b
+    inc     b
+    inc     h
+    inc     h
+    ld      a, (bc)
+    ld      c, a
+    ld      a, (hl)
+    sbc     a, c
+    ld      h, a
+    ld      l, d
+    ret
+
+;;; fixed_product = fixed_x * fixed_y, unsigned 16 x 16 bits to 32
+;;;
+;;; Uses all the registers. 956 to 989 T-states with the call.
+mul16:
+    ld      a, (fixed_y)
+    ld      e, a
+    ld      a, (fixed_x)
+    call    mul8
+    ld      (fixed_product), hl
+    ld      a, (fixed_x + 1)
+    call    mul8
+    push    hl                          ; x1 * y0
+    ld      a, (fixed_y + 1)
+    ld      e, a
+    ld      a, (fixed_x)
+    call    mul8
+    push    hl                          ; x0 * y1
+    ld      a, (fixed_x + 1)
+    call    mul8
+    ld      (fixed_product + 2), hl
+
+    ; the middle two go in a byte up
+    pop     de
+    ld      hl, #fixed_product + 1
+    ld      a, (hl)
+    add     a, e
+    ld      (hl), a
+    inc     hl
+    ld      a, (hl)
+    adc     a, d
+    ld      (hl), a
+    inc     hl
+    jr      nc, 00001$
+    inc     (hl)
+00001$:
+    pop     de
+    ld      hl, #fixed_product + 1
+    ld      a, (hl)
+    add     a, e
+    ld      (hl), a
+    inc     hl
+    ld      a, (hl)
+    adc     a, d
+    ld      (hl), a
+    inc     hl
+    ret     nc
+    inc     (hl)
+    ret
+
+;;; Load two word arguments as magnitudes, bc = |first| and de = |second|,
+;;; with the sign of their product pushed under the return address
+fixed_args:
+    ld      hl, #4
+    add     hl, sp
+    ld      c, (hl)
+    inc     hl
+    ld      b, (hl)
+    inc     hl
+    ld      e, (hl)
+    inc     hl
+    ld      d, (hl)
+    pop     hl
+    ld      a, b
+    xor     a, d
+    push    af                          ; sign in bit 7
+    push    hl
+
+    bit     7, b
+    jr      z, 00001$
+    xor     a, a
+    sub     a, c
+    ld      c, a
+    sbc     a, a
+    sub     a, b
+    ld      b, a
+00001$:
+    bit     7, d
+    ret     z
+    xor     a, a
+    sub     a, e
+    ld      e, a
+    sbc     a, a
+    sub     a, d
+    ld      d, a
+    ret
+
+;;; fixed8_t fixed8_mul( fixed8_t a, fixed8_t b )
+;;;
+;;; 8.8 a * b. 1213 to 1296 T-states.
+_fixed8_mul:
+    call    fixed_args
+    ld      (fixed_x), bc
+    ld      (fixed_y), de
+    call    mul16
+    ld      hl, (fixed_product + 1)
+    pop     af
+    ret     p
+    xor     a, a
+    sub     a, l
+    ld      l, a
+    sbc     a, a
+    sub     a, h
+    ld      h, a
+    ret
+
+;;; fixed8_t fixed8_div( fixed8_t a, fixed8_t b )
+;;;
+;;; 8.8 a / b, from the reciprocal of the top 8 bits of b, so within about
+;;; 1 part in 128, or 2 256ths for results under 1.0. b of 1 256th has no
+;;; reciprocal in the table and is an exact shift. Overflow and b = 0 give
+;;; 0x7fff or -0x7fff. 1405 to 2157 T-states, more the bigger b is, and
+;;; under 430 for b = 0 or 1 256th.
+_fixed8_div:
+    call    fixed_args
+    ld      (fixed_x), bc
+    ld      a, d
+    or      a, e
+    jr      z, 00004$
+
+    ; b down to 8 bits, counting the shifts in b and rounding
+    ld      bc, #0
+00001$:
+    ld      a, d
+    or      a, a
+    jr      z, 00002$
+    srl     d
+    rr      e
+    sbc     a, a
+    ld      c, a                        ; 0xff if a 1 went
+    inc     b
+    jr      00001$
+00002$:
+    ld      a, e
+    sub     a, c
+    jr      nz, 00003$
+    ld      a, #0x80                    ; rounded up to 256
+    inc     b
+00003$:
+    dec     a                           ; 0 only for b = 1, no shifts, 0 was caught above
+    jr      z, 00008$
+    inc     a
+    ld      l, a
+    ld      h, #RECIPROCAL_LO
+    ld      a, (hl)
+    inc     h
+    ld      h, (hl)
+    ld      l, a
+    ld      (fixed_y), hl
+    push    bc
+    call    mul16
+    pop     bc
+
+    ; a * 65536 / b is 16 bits up, 8.8 wants 8, less the shifts
+    ld      hl, (fixed_product + 1)
+    ld      a, (fixed_product + 3)
+    inc     b
+    jr      00006$
+00005$:
+    srl     a
+    rr      h
+    rr      l
+00006$:
+    djnz    00005$
+    or      a, a
+    jr      nz, 00004$
+    bit     7, h
+    jr      z, 00007$
+00004$:
+    ld      hl, #0x7fff                 ; too big
+00007$:
+    pop     af
+    ret     p
+    xor     a, a
+    sub     a, l
+    ld      l, a
+    sbc     a, a
+    sub     a, h
+    ld      h, a
+    ret
+
+    ; a / 1 256th is a shifted up 8, exact, overflowing from 0x80
+00008$:
+    ld      hl, (fixed_x)
+    ld      a, h
+    or      a, a
+    jr      nz, 00004$
+    bit     7, l
+    jr      nz, 00004$
+    ld      h, l
+    ld      l, a
+    jr      00007$
+
+;;; Make the 16.16 number at hl its magnitude
+fixed_abs32:
+    inc     hl
+    inc     hl
+    inc     hl
+    bit     7, (hl)
+    ret     z
+    dec     hl
+    dec     hl
+    dec     hl
+    xor     a, a
+    sub     a, (hl)
+    ld      (hl), a
+    inc     hl
+    ld      a, #0
+    sbc     a, (hl)
+    ld      (hl), a
+    inc     hl
+    ld      a, #0
+    sbc     a, (hl)
+    ld      (hl), a
+    inc     hl
+    ld      a, #0
+    sbc     a, (hl)
+    ld      (hl), a
+    ret
+
+;;; fixed_sum += fixed_product
+fixed_sum_add:
+    ld      hl, (fixed_sum)
+    ld      de, (fixed_product)
+    add     hl, de
+    ld      (fixed_sum), hl
+    ld      hl, (fixed_sum + 2)
+    ld      de, (fixed_product + 2)
+    adc     hl, de
+    ld      (fixed_sum + 2), hl
+    ret
+
+;;; fixed16_t fixed16_mul( fixed16_t a, fixed16_t b )
+;;;
+;;; 16.16 a * b, four 16 x 16 bit multiplies. 4881 to 5225 T-states.
+_fixed16_mul:
+    ld      hl, #2
+    add     hl, sp
+    ld      de, #fixed_a
+    ld      bc, #8
+    ldir                                ; fixed_a and fixed_b
+    ld      a, (fixed_a + 3)
+    ld      hl, #fixed_b + 3
+    xor     a, (hl)
+    push    af                          ; sign in bit 7
+    ld      hl, #fixed_a
+    call    fixed_abs32
+    ld      hl, #fixed_b
+    call    fixed_abs32
+
+    ; high words, only the low 16 bits of their product are kept
+    ld      hl, (fixed_a + 2)
+    ld      (fixed_x), hl
+    ld      hl, (fixed_b + 2)
+    ld      (fixed_y), hl
+    call    mul16
+    ld      hl, (fixed_product)
+    ld      (fixed_sum + 2), hl
+
+    ; low words, only the high 16 bits
+    ld      hl, (fixed_a)
+    ld      (fixed_x), hl
+    ld      hl, (fixed_b)
+    ld      (fixed_y), hl
+    call    mul16
+    ld      hl, (fixed_product + 2)
+    ld      (fixed_sum), hl
+
+    ; the two across
+    ld      hl, (fixed_a + 2)
+    ld      (fixed_x), hl
+    call    mul16
+    call    fixed_sum_add
+    ld      hl, (fixed_a)
+    ld      (fixed_x), hl
+    ld      hl, (fixed_b + 2)
+    ld      (fixed_y), hl
+    call    mul16
+    call    fixed_sum_add
+
+    ld      hl, (fixed_sum)
+    ld      de, (fixed_sum + 2)
+    pop     af
+    ret     p
+    xor     a, a
+    sub     a, l
+    ld      l, a
+    ld      a, #0
+    sbc     a, h
+    ld      h, a
+    ld      a, #0
+    sbc     a, e
+    ld      e, a
+    ld      a, #0
+    sbc     a, d
+    ld      d, a
+    ret
+
+;;; fixed8_t fixed8_sin( uint16_t angle )
+;;; fixed8_t fixed8_cos( uint16_t angle )
+;;;
+;;; 8.8, exact to the nearest 256th. 84 and 107 T-states.
+_fixed8_cos:
+    ld      hl, #2
+    add     hl, sp
+    ld      a, (hl)
+    add     a, #QUARTER_TURN
+    ld      l, a
+    jr      sine_lookup
+_fixed8_sin:
+    ld      hl, #2
+    add     hl, sp
+    ld      l, (hl)
+sine_lookup:
+    ld      h, #SINE_LO
+    ld      a, (hl)
+    inc     h
+    ld      h, (hl)
+    ld      l, a
+    ret
+
+;;; uint8_t fixed_atan2( int16_t y, int16_t x )
+;;;
+;;; Angle from the origin to x, y, 0 along x and 64 along y, from the
+;;; difference of the logs of x and y. Large x and y are shifted down to
+;;; 8 bits first. Within 1 of the true angle, 0 for 0, 0. 260 to 743
+;;; T-states, 409 on average and more for large x and y.
+_fixed_atan2:
+    ld      hl, #2
+    add     hl, sp
+    ld      e, (hl)
+    inc     hl
+    ld      d, (hl)                     ; de = y
+    inc     hl
+    ld      c, (hl)
+    inc     hl
+    ld      b, (hl)                     ; bc = x
+    ld      h, b
+    ld      l, d
+    push    hl                          ; signs in bit 7, x in h and y in l
+
+    bit     7, b
+    jr      z, 00001$
+    xor     a, a
+    sub     a, c
+    ld      c, a
+    sbc     a, a
+    sub     a, b
+    ld      b, a
+00001$:
+    bit     7, d
+    jr      z, 00003$
+    xor     a, a
+    sub     a, e
+    ld      e, a
+    sbc     a, a
+    sub     a, d
+    ld      d, a
+    jr      00003$
+
+    ; down to 8 bits each
+00002$:
+    srl     b
+    rr      c
+    srl     d
+    rr      e
+00003$:
+    ld      a, b
+    or      a, d
+    jr      nz, 00002$
+
+    ld      h, #LOG2
+    ld      a, e
+    cp      a, c
+    jr      nc, 00004$
+
+    ; below the diagonal, log x - log y
+    or      a, a
+    jr      z, 00006$                   ; along x, a = 0
+    ld      l, c
+    ld      a, (hl)
+    ld      l, e
+    sub     a, (hl)
+    ld      l, a
+    ld      h, #ATAN
+    ld      a, (hl)
+    jr      00006$
+
+    ; above it, a quarter turn less log y - log x
+00004$:
+    ld      a, c
+    or      a, a
+    jr      nz, 00005$
+    or      a, e
+    jr      z, 00006$                   ; 0, 0 is 0
+    ld      a, #QUARTER_TURN            ; along y
+    jr      00006$
+00005$:
+    ld      l, e
+    ld      a, (hl)
+    ld      l, c
+    sub     a, (hl)
+    ld      l, a
+    ld      h, #ATAN
+    ld      a, #QUARTER_TURN
+    sub     a, (hl)
+
+    ; into the quadrant
+00006$:
+    pop     hl
+    bit     7, h
+    jr      z, 00007$
+    neg
+    add     a, #QUARTER_TURN * 2
+00007$:
+    bit     7, l
+    jr      z, 00008$
+    neg
+00008$:
+    ld      l, a
+    ret
@@ -0,0 +1,185 @@
+;;; \file im2_bee.s
+;;;
+;;; \brief Interrupt mode 2 dispatch to C handlers
+;;;
+;;; \copyright Copyright 2022 UnderM4hz
+;;; Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+;;; to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+;;; and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+;;; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;;; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+;;; WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;;;
+;;; Feel free to give credit
+;;;
+;;; crt0_bee.s leaves the cpu in im 1. im2_init() switches to im 2 with the
+;;; vector table at IM2_TABLE, at the top of the lower 32K just above the
+;;; stack, and points every vector at a handler that does nothing. The pio
+;;; puts the vector on the bus: port a on vector 0 and port b on vector 1.
+;;; Port b bit 7 follows vertical blanking, so im2_vsync_enable() gives an
+;;; interrupt at the start of each blank.
+;;;
+;;; Each vector has a stub that saves af, bc, de, hl and iy and calls the
+;;; C handler, which runs with interrupts off. sdcc keeps ix itself and
+;;; leaves the alternate registers alone. A handler that uses the crtc has
+;;; to leave its register select as it found it.
+;;;
+;;; Dispatch costs 197 T-states plus the handler: 19 to take the interrupt,
+;;; 106 to save and call and 72 to restore and return. An unset vector is
+;;; 207.
+;;;
+;;; Called from C as __sdcccall(0), see vram_bee.s.
+
+    .module im2
+    .globl  _im2_init
+    .globl  _im2_handler_set
+    .globl  _im2_vsync_enable
+
+IM2_TABLE = 0x7ff8                      ; i = 0x7f, vector bytes 0xf8-0xff
+IM2_VECTORS = 4
+IM2_VECTOR_PIO_A = 0
+IM2_VECTOR_PIO_B = 1
+
+PIO_A_CONTROL_PORT = 0x01
+PIO_B_CONTROL_PORT = 0x03
+PIO_INT_CONTROL = 0xb7                  ; enabled, or, active high, mask follows
+PIO_INT_MASK = 0x7f                     ; bit 7 only
+
+    .area   _DATA
+
+im2_handlers:
+    .ds     IM2_VECTORS * 2
+
+    .area   _CODE
+
+;;; void im2_init()
+;;;
+;;; Switch to im 2 with no handlers, call once before setting any. The pio
+;;; keeps whatever interrupts it had enabled, now on their own vectors.
+_im2_init:
+    di
+    ld      hl, #im2_none
+    ld      (im2_handlers), hl
+    ld      hl, #im2_handlers
+    ld      de, #im2_handlers + 2
+    ld      bc, #IM2_VECTORS * 2 - 2
+    ldir
+
+    ld      hl, #IM2_TABLE
+    ld      de, #im2_stub_0
+    ld      bc, #im2_stub_1 - im2_stub_0
+    ld      a, #IM2_VECTORS
+00001$:
+    ld      (hl), e
+    inc     hl
+    ld      (hl), d
+    inc     hl
+    ex      de, hl
+    add     hl, bc
+    ex      de, hl
+    dec     a
+    jr      nz, 00001$
+
+    ld      a, #( IM2_TABLE + IM2_VECTOR_PIO_A * 2 ) & 0xff
+    out     (#PIO_A_CONTROL_PORT), a
+    ld      a, #( IM2_TABLE + IM2_VECTOR_PIO_B * 2 ) & 0xff
+    out     (#PIO_B_CONTROL_PORT), a
+
+    ld      a, #IM2_TABLE >> 8
+    ld      i, a
+    im      2
+    ei
+    ret
+
+;;; void im2_handler_set( uint16_t vector, void (*handler)() )
+;;;
+;;; Run handler on an interrupt with vector 0-3, 0 for none. Safe to call
+;;; with interrupts on.
+;;;
+;;; On an nmos z80, ld a, i reads p/v as 0 if an interrupt is taken while
+;;; it runs, which would leave interrupts off for good. The interrupt has
+;;; run by the second read, so that one is right. The same check is made
+;;; wherever interrupts are held off and restored.
+_im2_handler_set:
+    pop     bc
+    pop     de                          ; de = vector
+    pop     hl                          ; hl = handler
+    push    hl
+    push    de
+    push    bc
+
+    ld      a, h
+    or      a, l
+    jr      nz, 00001$
+    ld      hl, #im2_none
+00001$:
+    ex      de, hl
+    add     hl, hl
+    ld      bc, #im2_handlers
+    add     hl, bc
+
+    ; not half a pointer for an interrupt in between
+    ld      a, i                        ; p/v = interrupts enabled
+    jp      pe, 00002$
+    ld      a, i                        ; nmos p/v is 0 if the first took an interrupt
+00002$:
+    di
+    ld      (hl), e
+    inc     hl
+    ld      (hl), d
+    ret     po
+    ei
+    ret
+
+;;; void im2_vsync_enable()
+;;;
+;;; Interrupt on pio port b bit 7 going high, the start of vertical
+;;; blanking, on vector 1. Port b stays in the bit mode the rom set up.
+_im2_vsync_enable:
+    ld      a, #PIO_INT_CONTROL
+    out     (#PIO_B_CONTROL_PORT), a
+    ld      a, #PIO_INT_MASK
+    out     (#PIO_B_CONTROL_PORT), a
+    ret
+
+;;; One stub a vector, all the same size
+im2_stub_0:
+    push    af
+    push    hl
+    ld      hl, (im2_handlers + 0)
+    jp      im2_dispatch
+im2_stub_1:
+    push    af
+    push    hl
+    ld      hl, (im2_handlers + 2)
+    jp      im2_dispatch
+im2_stub_2:
+    push    af
+    push    hl
+    ld      hl, (im2_handlers + 4)
+    jp      im2_dispatch
+im2_stub_3:
+    push    af
+    push    hl
+    ld      hl, (im2_handlers + 6)
+    jp      im2_dispatch
+
+;;; Call the handler at hl, af and hl are already saved
+im2_dispatch:
+    push    bc
+    push    de
+    push    iy
+    call    im2_call
+    pop     iy
+    pop     de
+    pop     bc
+    pop     hl
+    pop     af
+    ei
+    reti
+
+im2_call:
+    jp      (hl)
+
+im2_none:
+    ret
@@ -0,0 +1,78 @@
+;;; \file lz_bee.s
+;;;
+;;; \brief Decompressor for data packed by beepack
+;;;
+;;; \copyright Copyright 2022 UnderM4hz
+;;; Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+;;; to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+;;; and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+;;; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;;; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+;;; WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;;;
+;;; Feel free to give credit
+;;;
+;;; Packed data is a list of tokens, ending with 0:
+;;;
+;;;     0x01-0x7f   that many literal bytes follow
+;;;     0x80-0xff   copy ( token & 0x7f ) + 4 bytes from the offset that
+;;;                 follows (2 bytes), counted back from the output
+;;;
+;;; Copies go forwards a byte at a time, so a match can overlap its own
+;;; output to repeat a run. Matches read back from the destination, so
+;;; video ram has to stay switched to the same bank for the whole unpack.
+
+    .module lz
+    .globl  _lz_unpack
+
+LZ_MATCH_MIN = 4
+
+    .area   _CODE
+
+;;; void lz_unpack( uint8_t *dest, const uint8_t *src )
+;;;
+;;; 21 T-states a byte with ldir, plus about 60 a literal run and 130 a
+;;; match. The demo's title screen unpacks at 2800 bytes a frame (24 T-states
+;;; a byte) and its glyphs at 2000 (34 T-states a byte).
+_lz_unpack:
+    pop     bc
+    pop     de                          ; de = dest
+    pop     hl                          ; hl = src
+    push    hl
+    push    de
+    push    bc
+
+00001$:
+    ld      a, (hl)
+    inc     hl
+    or      a, a
+    ret     z
+    jp      m, 00002$
+
+    ; literals
+    ld      c, a
+    ld      b, #0
+    ldir
+    jp      00001$
+
+00002$:
+    ; match, hl = dest - offset
+    and     a, #0x7f
+    add     a, #LZ_MATCH_MIN
+    ld      c, a
+    ld      b, #0
+    ld      a, (hl)
+    inc     hl
+    push    hl
+    ld      h, (hl)
+    ld      l, a
+    ld      a, e
+    sub     a, l
+    ld      l, a
+    ld      a, d
+    sbc     a, h
+    ld      h, a
+    ldir
+    pop     hl
+    inc     hl
+    jp      00001$
@@ -12,13 +12,164 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "crt_modes.h"                  // Made by pack/beecrt in the build directory
+
 #define VDU_VSYNC_MASK ( 1 << crtStatusVSync )
 #define SOUND_MASK 0x60
 
+#define SOUND_CHANNELS 3                // Time sliced channels in sound_bee.s
+#define SOUND_CLOCK 3375000
+#define SOUND_SLOT_T 320                // T-states each channel has the speaker for
+#define SOUND_HOLD 0xff                 // Frames of a channel the music has, never counted down
+
+///< Phase step for a pitch in Hz, at most about 1750
+#define SOUND_STEP(hz) ( (uint16_t)( (uint32_t)(hz) * 65536 / ( SOUND_CLOCK / ( SOUND_SLOT_T * SOUND_CHANNELS ) ) ) )
+
 #define TILE_TABLE_ADDRESS ((uint8_t*)0xF000)
 #define PIXEL_TABLE_ADDRESS ((uint8_t*)0xF800)
 #define COLOUR_TABLE_ADDRESS ((uint8_t*)0xF800)
 
+#define VDU_COLUMNS VDU_MODE_COLUMNS
+#define VDU_ROWS VDU_MODE_ROWS
+#define VDU_DEMO ( VDU_MODE == VDU_MODE_64X16 ) // The pages, shadow screen, sprites and tile map are laid out for 64x16
+
+#define VDU_PAGE_SIZE ( VDU_COLUMNS * VDU_ROWS ) // Two pages fit in the 2K tile ram at 64x16
+#define VDU_RAM_MASK 0x7FF              // The display start wraps round the 2K tile ram
+
+#if VDU_DEMO
+///< Offset of a row and row of an offset with 64 columns, without a
+///< multiply or divide: row * 64 is the row as a high byte shifted down 2
+#define vdu_row_offset( row ) ( (uint16_t)( (uint16_t)(uint8_t)(row) << 8 ) >> 2 )
+#define vdu_offset_row( offset ) ( (uint8_t)( (uint16_t)( (offset) << 2 ) >> 8 ) )
+#else
+///< Offset of a row from the table beecrt made, 80 or 40 columns can't be a shift
+static const uint16_t g_vdu_row_offsets[VDU_ROWS] = VDU_MODE_ROW_OFFSETS;
+#define vdu_row_offset( row ) ( g_vdu_row_offsets[row] )
+#endif
+
+///< Tile ram address of a cell on the screen
+#define vdu_tile_address( column, row ) ( TILE_TABLE_ADDRESS + vdu_row_offset( row ) + ( column ) )
+
+#define DISPLAY_TEST_CHANGES 32         // Cells display_test changes each pass
+
+#define FRAME_LINE_T 216                // 108 characters a line in every mode, see pack/beecrt
+#define FRAME_LINES 313                 // 19 rows of 16 lines and 9 more
+#define FRAME_CATCH_UP 4                // Most updates run for one pass, the rest of a long stall is dropped
+#define FRAME_METER_ROW 0
+#define FRAME_METER_COLOUR 0x40         // Background colour behind blank tiles
+
+#define BANK_WINDOW_SIZE 0x8000         // Banks are switched in at 0x0000-0x7FFF
+#define BANK_BUFFER_ADDRESS ((uint8_t*)0x8100) // Upper ram after the bank stub
+#define BANK_BUFFER_SIZE 0x3000         // Below where cp/m sits, for running from cp/m
+#define BANK_NONE 0xff
+
+#define GLYPH_SIZE 16                   // Bytes of pcg ram a glyph
+#define GLYPH_SLOTS_MAX 128             // Pcg tiles 128-255
+#define GLYPH_UPLOADS_MAX 16            // A vertical blank's worth, about 700 T-states each from a bank
+#define GLYPH_NONE 0xff
+#define GLYPH_TEST_DATA ((const uint8_t*)0x0100) // 256 glyphs of noise for display_test, the program's own code
+#define GLYPH_TEST_FIRST 160            // Tiles the cache shows them on, after display_test's own
+#define GLYPH_TEST_SLOTS 32
+#define GLYPH_TEST_ROW 7                // Last row above the title
+#define GLYPH_TEST_CELLS 16             // Fewer than the slots, so unused slots stay cached
+#define GLYPH_TEST_CHANGES 4            // Cells given a new glyph each pass
+
+#define SPRITE_MAX 8
+#define SPRITE_TILE_FIRST 192           // 4 pcg tiles a sprite on each page, up to 255
+#define SPRITE_SHIFT_SIZE 64            // Two columns of 16 rows of keep and set bytes
+#define SPRITE_IMAGE_SIZE ( SPRITE_SHIFT_SIZE * 8 ) // From pack/beesprite, a shift for each pixel of a tile
+#ifndef SPRITE_GLYPHS_MAX
+#define SPRITE_GLYPHS_MAX 32            // Pcg glyphs composed a frame, 4 a sprite at about 730 T-states each
+#endif
+#define SPRITE_X_MAX ( VDU_COLUMNS * 8 - 8 )
+#define SPRITE_Y_MAX ( VDU_ROWS * 16 - 16 )
+
+#define TILEMAP_CHUNK_COLUMNS 16        // Columns packed together by pack/beepack -w
+#define TILEMAP_STEPS_MAX 2             // Columns scrolled a frame
+#define TILEMAP_BUFFER_ADDRESS ((uint8_t*)0xB100) // A chunk unpacked, upper ram after the bank buffer
+#define TILEMAP_NONE 0xffff
+
+#define IM2_VECTOR_PIO_A 0
+#define IM2_VECTOR_PIO_B 1              // Vsync, after im2_vsync_enable()
+
+#define OVERLAY_ADDRESS 0x6000          // Overlays run here, up to the data at 0x7000
+
+#define FIXED8( n ) ( (fixed8_t)( (n) * 256 ) )
+#define FIXED16( n ) ( (fixed16_t)( (n) * 65536L ) )
+#define FIXED_QUARTER_TURN 64           // Angles are 256 a turn
+
+///< Fixed point numbers for fixed_bee.s, 1.0 is 256 and 65536
+typedef int16_t fixed8_t;               // 8.8
+typedef int32_t fixed16_t;              // 16.16
+
+///< A packed asset, kept unpacked in a bank on a 128K machine
+typedef struct BankAsset {
+
+    const uint8_t *packed;              // From pack/beepack
+    uint16_t size;                      // Unpacked, at most BANK_BUFFER_SIZE
+    uint8_t bank;                       // Set by bank_asset_load(), BANK_NONE unpacks each time
+    uint16_t address;                   // In the bank
+} BankAsset;
+
+///< A pcg tile holding a glyph for glyph_acquire()
+typedef struct GlyphSlot {
+
+    uint8_t glyph;                      // Virtual glyph, if g_glyph_slot_of[] agrees
+    uint8_t refs;                       // On the lru list when 0
+    uint8_t older;                      // Lru list links, GLYPH_NONE at the ends
+    uint8_t newer;
+    bool queued;                        // Waiting for glyph_cache_flush()
+} GlyphSlot;
+
+///< A software sprite, 8x16 pixels drawn by sprite_draw()
+typedef struct Sprite {
+
+    const uint8_t *image;               // SPRITE_IMAGE_SIZE bytes from pack/beesprite, 0 hides it
+    const void *const *code;            // Its 8 routines from beesprite -c, drawn with instead when set
+    uint16_t x;                         // Pixels, 0 to SPRITE_X_MAX
+    uint8_t y;                          // Pixels, 0 to SPRITE_Y_MAX
+    uint8_t colour;                     // Of the cells it covers
+} Sprite;
+
+///< Cells a sprite was drawn on, to put the background back
+typedef struct SpriteCells {
+
+    uint16_t offset;                    // Top left cell on the page
+    uint8_t cells;                      // Bit for each of g_sprite_cell_offsets[], 0 for none
+} SpriteCells;
+
+///< Sound effect waveforms
+enum {
+
+    soundTone = 0,                      // Square wave
+    soundNoise,                         // Random bits, the pitch sets how often they change
+    soundPwm,                           // Narrow pulses, a thinner buzzing tone
+};
+
+///< A sound effect, started with sound_play()
+typedef struct SoundEffect {
+
+    uint8_t type;
+    uint8_t priority;                   // Takes a channel from equal or lower priority
+    uint8_t frames;                     // Length, up to 254
+    uint16_t step;                      // Pitch, see SOUND_STEP()
+    int16_t sweep;                      // Added to step every frame
+    uint8_t duty;                       // Pulse width of soundPwm out of 256
+} SoundEffect;
+
+///< Channel state, the first five fields are read by sound_render() in sound_bee.s
+typedef struct SoundChannel {
+
+    uint16_t phase;                     // Wraps once a period
+    uint16_t step;                      // Added to phase each slot
+    uint8_t threshold;                  // Speaker on while phase high byte is at or below this
+    uint8_t pattern;                    // Bit 7 gates the speaker, 0 is silent
+    uint8_t noise;                      // 0xff flips pattern bit 7 at random each period
+    uint8_t priority;
+    uint8_t frames;                     // Frames left to play, 0 is free
+    int16_t sweep;
+} SoundChannel;
+
 // From the R6545 crt display controller manual
 
 ///< crt/vdu status byte
@@ -58,6 +209,82 @@ static volatile __sfr __at 0x02 SoundPort;
 static volatile __sfr __at 0x0C CrtRegPort;
 static volatile __sfr __at 0x0D CrtDataPort;
 static volatile __sfr __at 0x08 VduBankPort;
+static volatile __sfr __at 0x0B LatchRomPort;
+
+///< Unrolled fill and copy in vram_bee.s, see there for T-state costs
+///< Arguments are words on the stack, byte values are passed as words
+void vram_fill( uint8_t *dest, uint16_t length, uint16_t value ) __sdcccall(0);
+void vram_fill_rows( uint8_t *dest, uint16_t rows, uint16_t value ) __sdcccall(0);
+void vram_fill_column( uint8_t *dest, uint16_t rows, uint16_t value ) __sdcccall(0);
+void vram_copy( uint8_t *dest, const uint8_t *src, uint16_t length ) __sdcccall(0);
+
+///< Unpack beepack data, in lz_bee.s
+void lz_unpack( uint8_t *dest, const uint8_t *src ) __sdcccall(0);
+
+///< 128K memory banks in bank_bee.s
+uint8_t bank_init() __sdcccall(0);
+void bank_copy( uint16_t bank, uint8_t *dest, const uint8_t *src, uint16_t length ) __sdcccall(0);
+
+///< Code overlays read through the bdos, in overlay_bee.s
+///< Names are 11 character fcb names, false without cp/m or the file
+bool overlay_load( const char *name ) __sdcccall(0);
+
+///< Run the overlay that is in, its first function is at OVERLAY_ADDRESS
+#define overlay_run() ( ( (void (*)())OVERLAY_ADDRESS )() )
+
+///< Interrupt mode 2 dispatch in im2_bee.s, 197 T-states plus the handler
+///< Handlers are plain C functions, run with interrupts off
+void im2_init() __sdcccall(0);
+void im2_handler_set( uint16_t vector, void (*handler)() ) __sdcccall(0);
+void im2_vsync_enable() __sdcccall(0);
+
+///< Draw a sprite on its four pcg glyphs, in sprite_bee.s
+///< From pre-shifted data in 2945 T-states, or with a compiled routine in
+///< 1610 plus what the routine takes, 550 on average for the demo sprites
+void sprite_compose( uint8_t *dest, const uint8_t **backgrounds, const uint8_t *image, uint16_t row ) __sdcccall(0);
+void sprite_compose_code( uint8_t *dest, const uint8_t **backgrounds, const void *code, uint16_t row ) __sdcccall(0);
+
+///< Fixed point from page aligned tables, in fixed_bee.s
+///< fixed_init() unpacks the tables to upper ram, once before the rest
+///< Without upper ram (g_upper_ram) there are no tables, so none of these can be used
+///< Costs are from 84 T-states for sin to about 5000 for a 16.16 multiply
+void fixed_init() __sdcccall(0);
+uint16_t fixed_mul8( uint16_t a, uint16_t b ) __sdcccall(0);
+fixed8_t fixed8_mul( fixed8_t a, fixed8_t b ) __sdcccall(0);
+fixed8_t fixed8_div( fixed8_t a, fixed8_t b ) __sdcccall(0);
+fixed16_t fixed16_mul( fixed16_t a, fixed16_t b ) __sdcccall(0);
+fixed8_t fixed8_sin( uint16_t angle ) __sdcccall(0);
+fixed8_t fixed8_cos( uint16_t angle ) __sdcccall(0);
+uint8_t fixed_atan2( int16_t y, int16_t x ) __sdcccall(0);
+
+///< Load crt registers 0-15 in one burst, in crt_bee.s, 572 T-states
+void crt_registers_load( const uint8_t *registers ) __sdcccall(0);
+
+///< Play the sound channels while the vsync status bit stays as vsync, in sound_bee.s
+///< Returns the SOUND_SLOT_T slots that took
+uint16_t sound_render( uint16_t vsync ) __sdcccall(0);
+
+///< Two channel music on sound channels 0 and 1, in sound_bee.s
+///< Songs are made from text scores by music/beemusic, 0 stops
+void music_play( const uint8_t *song ) __sdcccall(0);
+uint16_t music_frame() __sdcccall(0);
+
+///< Demo tune, built from music/demo.txt
+extern const uint8_t song_demo[];
+
+///< Demo assets packed by pack/beepack from src/assets
+extern const uint8_t title_screen[];    // Half a page of tiles
+extern const uint8_t demo_glyphs[];     // 16 pcg glyphs
+
+///< Demo sprites pre-shifted by pack/beesprite from src/assets/sprites.txt
+extern const uint8_t demo_sprites[];    // SPRITE_IMAGE_SIZE bytes each
+extern const void *const demo_sprite_code[]; // Compiled by beesprite -c, 8 shifts each
+extern const uint8_t world_demo[];      // A world 256 columns wide, packed by beepack -w
+
+#if VDU_DEMO
+BankAsset g_title_asset = { title_screen, VDU_PAGE_SIZE / 2 };
+#endif
+BankAsset g_glyph_asset = { demo_glyphs, 16 * 16 };
 
 ///< Set crt register value
 void vdu_reg_set( unsigned char reg, unsigned char value ) {
@@ -66,27 +293,13 @@ void vdu_reg_set( unsigned char reg, unsigned char value ) {
     CrtDataPort = value;
 }
 
-///< Setup crt to 64x16 tiles and hide the cursor
-///< There's a fixed set combination of values that will work at each resolution
+///< Setup crt to the mode chosen at build time, and hide the cursor
+///< There's a fixed set combination of values that will work at each resolution,
+///< pack/beecrt holds them and checks each keeps the 50 Hz frame
 ///< Changing individual values will often result in a blank screen on real hardware
 void vdu_crt_setup() {
 
-    vdu_reg_set( crtHorizontalTotalChars, 108 - 1 );    // horizontal sync timing constant
-    vdu_reg_set( crtHorizontalDisplayedChars, 64 );     // number of displayed characters per line
-    vdu_reg_set( crtHorizontalSyncPosition, 81 );       // horizontal sync position
-    vdu_reg_set( crtHorizontalVerticalSyncWidths, 55 ); // horizontal and vertical sync width
-    vdu_reg_set( crtVerticalTotalRows, 19 - 1 );        // vertical sync width
-    vdu_reg_set( crtVerticalTotalLineAdjust, 9 );       // vertical sync timing constant
-    vdu_reg_set( crtVerticalDisplayedRows, 16 );        // number of displayed rows per screen
-    vdu_reg_set( crtVerticalSyncPosition, 17 );         // vertical sync position
-    vdu_reg_set( crtModeControl, 72 );                  // mode control constant
-    vdu_reg_set( crtRowScanLines, 16-1 );               // number of scan lines per character
-    vdu_reg_set( crtCursorStartLine, 0x20+15 );         // cursor mode and start line
-    vdu_reg_set( crtCursorEndLine, 15 );                // cursor end line
-    vdu_reg_set( crtDisplayStartAddressHigh, 0 );       // display start address relative to 0F000h
-    vdu_reg_set( crtDisplayStartAddressLow, 0 );
-    vdu_reg_set( crtCursorPositionHigh, 0 );            // cursor position
-    vdu_reg_set( crtCursorPositionLow, 0 );
+    crt_registers_load( g_vdu_mode_registers );
 }
 
 ///< Switch in vdu PCG or colour data at 0xF8000
@@ -95,16 +308,729 @@ void vdu_bank( int colour ) {
     VduBankPort = colour ? 0x47 : 0x07;
 }
 
+///< Wait for the start of the next vertical blank
+///< The sound channels play for the time spent waiting
+///< Returns the time waited in sound slots
+uint16_t vdu_vsync_wait() {
+
+    // Let a blank already under way finish first
+    uint16_t slots = sound_render( VDU_VSYNC_MASK );
+    return slots + sound_render( 0 );
+}
+
+#if VDU_DEMO
+///< Offset of the page being drawn, the other page is on screen
+uint16_t g_vdu_draw_page = VDU_PAGE_SIZE;
+
+///< Tiles and colours of the page being drawn
+///< Colour ram follows the tile ram, so each page has its own colours too
+#define vdu_draw_tiles() ( TILE_TABLE_ADDRESS + g_vdu_draw_page )
+#define vdu_draw_colours() ( COLOUR_TABLE_ADDRESS + g_vdu_draw_page )
+
+///< Show the page that was drawn and start drawing on the other one
+///< The display start is latched at the top of the frame, so setting it
+///< in the vertical blank swaps whole frames without tearing
+///< Returns the time waited for the blank in sound slots
+uint16_t vdu_flip() {
+
+    uint16_t slots = vdu_vsync_wait();
+
+    vdu_reg_set( crtDisplayStartAddressHigh, g_vdu_draw_page >> 8 );
+    vdu_reg_set( crtDisplayStartAddressLow, g_vdu_draw_page & 0xff );
+    g_vdu_draw_page ^= VDU_PAGE_SIZE;
+
+    return slots;
+}
+
+///< Columns of a row changed since the row was copied to a page
+///< Nothing has changed when first >= last
+typedef struct {
+
+    uint8_t first;
+    uint8_t last;
+} VduSpan;
+
+///< Shadow screen, drawn on in main ram and copied to the draw page by vdu_shadow_flush()
+uint8_t g_vdu_tiles[VDU_PAGE_SIZE];
+uint8_t g_vdu_colours[VDU_PAGE_SIZE];
+
+///< Changed spans per page, each change has to reach both pages
+VduSpan g_vdu_tile_spans[2][VDU_ROWS];
+VduSpan g_vdu_colour_spans[2][VDU_ROWS];
+
+///< Add a run of cells to the changed spans of both pages
+static void vdu_span_mark( VduSpan spans[2][VDU_ROWS], uint16_t offset, uint16_t length ) {
+
+    while( length ) {
+
+        uint8_t row = vdu_offset_row( offset );
+        uint8_t first = offset % VDU_COLUMNS;
+        uint8_t count = length < VDU_COLUMNS - first ? length : VDU_COLUMNS - first;
+        uint8_t last = first + count;
+
+        for( uint8_t page = 0; page < 2; page++ ) {
+
+            VduSpan *span = &spans[page][row];
+
+            if ( span->first >= span->last ) {
+
+                span->first = first;
+                span->last = last;
+            }
+            else {
+
+                if ( first < span->first ) span->first = first;
+                if ( last > span->last ) span->last = last;
+            }
+        }
+
+        offset += count;
+        length -= count;
+    }
+}
+
+///< Copy the changed spans of one page from the shadow to the screen
+static void vdu_span_copy( VduSpan *spans, uint8_t *screen, const uint8_t *shadow ) {
+
+    for( uint8_t row = 0; row < VDU_ROWS; row++, spans++ ) {
+
+        if ( spans->first < spans->last ) {
+
+            uint16_t offset = vdu_row_offset( row ) + spans->first;
+            vram_copy( screen + offset, shadow + offset, spans->last - spans->first );
+            spans->first = spans->last = 0;
+        }
+    }
+}
+
+///< Put tiles on the shadow screen
+void vdu_tiles_set( uint16_t offset, const uint8_t *tiles, uint16_t length ) {
+
+    memcpy( g_vdu_tiles + offset, tiles, length );
+    vdu_span_mark( g_vdu_tile_spans, offset, length );
+}
+
+void vdu_tiles_fill( uint16_t offset, uint8_t tile, uint16_t length ) {
+
+    memset( g_vdu_tiles + offset, tile, length );
+    vdu_span_mark( g_vdu_tile_spans, offset, length );
+}
+
+///< Put colours on the shadow screen
+void vdu_colours_set( uint16_t offset, const uint8_t *colours, uint16_t length ) {
+
+    memcpy( g_vdu_colours + offset, colours, length );
+    vdu_span_mark( g_vdu_colour_spans, offset, length );
+}
+
+void vdu_colours_fill( uint16_t offset, uint8_t colour, uint16_t length ) {
+
+    memset( g_vdu_colours + offset, colour, length );
+    vdu_span_mark( g_vdu_colour_spans, offset, length );
+}
+
+///< Fill whole rows of the shadow screen
+void vdu_rows_fill( uint8_t row, uint8_t rows, uint8_t tile, uint8_t colour ) {
+
+    uint16_t offset = vdu_row_offset( row );
+
+    vram_fill_rows( g_vdu_tiles + offset, rows, tile );
+    vram_fill_rows( g_vdu_colours + offset, rows, colour );
+    vdu_span_mark( g_vdu_tile_spans, offset, rows * VDU_COLUMNS );
+    vdu_span_mark( g_vdu_colour_spans, offset, rows * VDU_COLUMNS );
+}
+
+///< Fill a column of the shadow screen
+void vdu_column_fill( uint8_t column, uint8_t tile, uint8_t colour ) {
+
+    vram_fill_column( g_vdu_tiles + column, VDU_ROWS, tile );
+    vram_fill_column( g_vdu_colours + column, VDU_ROWS, colour );
+
+    for( uint16_t offset = column; offset < VDU_PAGE_SIZE; offset += VDU_COLUMNS ) {
+
+        vdu_span_mark( g_vdu_tile_spans, offset, 1 );
+        vdu_span_mark( g_vdu_colour_spans, offset, 1 );
+    }
+}
+
+///< Copy what changed on the shadow screen to the draw page
+///< Colour ram is switched in once for all the colour spans
+void vdu_shadow_flush() {
+
+    uint8_t page = g_vdu_draw_page / VDU_PAGE_SIZE;
+    VduSpan *spans = g_vdu_colour_spans[page];
+    bool colours = false;
+
+    vdu_span_copy( g_vdu_tile_spans[page], vdu_draw_tiles(), g_vdu_tiles );
+
+    for( uint8_t row = 0; row < VDU_ROWS; row++ )
+        if ( spans[row].first < spans[row].last )
+            colours = true;
+
+    if ( colours ) {
+
+        vdu_bank(1);
+        vdu_span_copy( spans, vdu_draw_colours(), g_vdu_colours );
+        vdu_bank(0);
+    }
+}
+#else
+///< Put tiles straight on the screen, there's no shadow screen outside 64x16
+void vdu_tiles_set( uint16_t offset, const uint8_t *tiles, uint16_t length ) {
+
+    vram_copy( TILE_TABLE_ADDRESS + offset, tiles, length );
+}
+#endif
+
+///< Unpack tiles straight to tile ram
+void vdu_tiles_unpack( uint16_t offset, const uint8_t *data ) {
+
+    lz_unpack( TILE_TABLE_ADDRESS + offset, data );
+}
+
+///< Unpack colours straight to colour ram
+void vdu_colours_unpack( uint16_t offset, const uint8_t *data ) {
+
+    vdu_bank(1);
+    lz_unpack( COLOUR_TABLE_ADDRESS + offset, data );
+    vdu_bank(0);
+}
+
+///< Unpack glyphs straight to pcg ram, from tile 128 + glyph
+void vdu_pcg_unpack( uint8_t glyph, const uint8_t *data ) {
+
+    vdu_bank(0);
+    lz_unpack( PIXEL_TABLE_ADDRESS + glyph * 16, data );
+}
+
+///< Banks found by bank_init(), 0 on a 32K or 64K machine
+uint8_t g_bank_count;
+
+///< Ram in the upper 32K, false on a 32K machine where it is roms, set by upper_ram_test()
+bool g_upper_ram;
+
+///< Whether upper ram keeps what is written to it, once at start up
+///< The tile map's buffer and the fixed point tables live there
+bool upper_ram_test() {
+
+    volatile uint8_t *test = TILEMAP_BUFFER_ADDRESS;
+    uint8_t saved = *test;
+    bool ram;
+
+    *test = 0x55;
+    ram = *test == 0x55;
+    *test = 0xaa;
+    ram = ram && *test == 0xaa;
+    *test = saved;
+    return ram;
+}
+
+///< Next free byte in the banks
+static uint8_t g_bank_next;
+static uint16_t g_bank_free;
+
+///< Unpack an asset into the banks, once at start up, so it only has to be copied
+///< after that. Without a bank or the room in one, it stays packed
+void bank_asset_load( BankAsset *asset ) {
+
+    asset->bank = BANK_NONE;
+
+    if ( asset->size > BANK_BUFFER_SIZE )
+        return;
+
+    if ( g_bank_free + asset->size > BANK_WINDOW_SIZE ) {
+
+        g_bank_next++;
+        g_bank_free = 0;
+    }
+    if ( g_bank_next >= g_bank_count )
+        return;
+
+    lz_unpack( BANK_BUFFER_ADDRESS, asset->packed );
+    bank_copy( g_bank_next, (uint8_t*)g_bank_free, BANK_BUFFER_ADDRESS, asset->size );
+
+    asset->bank = g_bank_next;
+    asset->address = g_bank_free;
+    g_bank_free += asset->size;
+}
+
+///< Copy an asset to dest, from its bank or by unpacking it
+///< Video ram and the rest of the upper 32K copy straight from the bank, the
+///< lower 32K is switched out by the bank so goes through the buffer
+void bank_asset_copy( const BankAsset *asset, uint8_t *dest ) {
+
+    if ( asset->bank == BANK_NONE ) {
+
+        lz_unpack( dest, asset->packed );
+    }
+    else if ( (uint16_t)dest >= BANK_WINDOW_SIZE ) {
+
+        bank_copy( asset->bank, dest, (const uint8_t*)asset->address, asset->size );
+    }
+    else {
+
+        bank_copy( asset->bank, BANK_BUFFER_ADDRESS, (const uint8_t*)asset->address, asset->size );
+        vram_copy( dest, BANK_BUFFER_ADDRESS, asset->size );
+    }
+}
+
+///< Pcg glyph cache, a virtual set of up to 256 glyphs shown on fewer pcg tiles
+///< Slots are counted by the tiles using them, unused ones go least recently used first
+static const uint8_t *g_glyph_data;     // GLYPH_SIZE bytes each
+static uint8_t g_glyph_bank;            // Bank g_glyph_data is in, BANK_NONE for main ram
+static uint8_t g_glyph_first;           // First tile the cache owns
+static GlyphSlot g_glyph_slots[GLYPH_SLOTS_MAX];
+static uint8_t g_glyph_slot_of[256];    // Slot each virtual glyph is in, GLYPH_NONE for none
+static uint8_t g_glyph_oldest = GLYPH_NONE;
+static uint8_t g_glyph_newest = GLYPH_NONE;
+static uint8_t g_glyph_queue[GLYPH_SLOTS_MAX]; // Slots to upload, in order
+static uint8_t g_glyph_queued;
+
+static void glyph_lru_remove( uint8_t slot ) {
+
+    GlyphSlot *s = &g_glyph_slots[slot];
+
+    if ( s->older == GLYPH_NONE )
+        g_glyph_oldest = s->newer;
+    else
+        g_glyph_slots[s->older].newer = s->newer;
+    if ( s->newer == GLYPH_NONE )
+        g_glyph_newest = s->older;
+    else
+        g_glyph_slots[s->newer].older = s->older;
+}
+
+static void glyph_lru_append( uint8_t slot ) {
+
+    GlyphSlot *s = &g_glyph_slots[slot];
+
+    s->older = g_glyph_newest;
+    s->newer = GLYPH_NONE;
+    if ( g_glyph_newest == GLYPH_NONE )
+        g_glyph_oldest = slot;
+    else
+        g_glyph_slots[g_glyph_newest].newer = slot;
+    g_glyph_newest = slot;
+}
+
+///< Cache glyphs, GLYPH_SIZE bytes each, on tiles first to first + slots - 1
+///< The glyphs are in main ram with bank BANK_NONE, or in a bank from a BankAsset
+void glyph_cache_init( const uint8_t *glyphs, uint8_t bank, uint8_t first, uint8_t slots ) {
+
+    g_glyph_data = glyphs;
+    g_glyph_bank = bank;
+    g_glyph_first = first;
+    g_glyph_queued = 0;
+    g_glyph_oldest = g_glyph_newest = GLYPH_NONE;
+    memset( g_glyph_slot_of, GLYPH_NONE, sizeof( g_glyph_slot_of ) );
+
+    for( uint8_t slot = 0; slot < slots; slot++ ) {
+
+        g_glyph_slots[slot].refs = 0;
+        g_glyph_slots[slot].queued = false;
+        glyph_lru_append( slot );
+    }
+}
+
+///< Tile showing a virtual glyph, 0 if every slot is in use
+///< Each acquire needs a glyph_release(). A glyph that wasn't in is uploaded
+///< by the next glyph_cache_flush(), before the page drawn with it is shown.
+uint8_t glyph_acquire( uint8_t glyph ) {
+
+    uint8_t slot = g_glyph_slot_of[glyph];
+    GlyphSlot *s;
+
+    if ( slot != GLYPH_NONE ) {
+
+        s = &g_glyph_slots[slot];
+        if ( !s->refs++ )
+            glyph_lru_remove( slot );
+        return g_glyph_first + slot;
+    }
+
+    slot = g_glyph_oldest;
+    if ( slot == GLYPH_NONE )
+        return 0;
+
+    s = &g_glyph_slots[slot];
+    glyph_lru_remove( slot );
+    if ( g_glyph_slot_of[s->glyph] == slot )
+        g_glyph_slot_of[s->glyph] = GLYPH_NONE;
+    g_glyph_slot_of[glyph] = slot;
+    s->glyph = glyph;
+    s->refs = 1;
+    if ( !s->queued ) {
+
+        s->queued = true;
+        g_glyph_queue[g_glyph_queued++] = slot;
+    }
+
+    return g_glyph_first + slot;
+}
+
+///< Done with a tile from glyph_acquire(), it stays cached until it is the oldest unused
+void glyph_release( uint8_t tile ) {
+
+    uint8_t slot = tile - g_glyph_first;
+
+    if ( !--g_glyph_slots[slot].refs )
+        glyph_lru_append( slot );
+}
+
+///< Upload queued glyphs to pcg ram, up to GLYPH_UPLOADS_MAX
+///< Called by frame_run() at the start of the vertical blank
+void glyph_cache_flush() {
+
+    uint8_t count = g_glyph_queued < GLYPH_UPLOADS_MAX ? g_glyph_queued : GLYPH_UPLOADS_MAX;
+
+    if ( !count )
+        return;
+
+    vdu_bank(0);
+    for( uint8_t i = 0; i < count; i++ ) {
+
+        uint8_t slot = g_glyph_queue[i];
+        GlyphSlot *s = &g_glyph_slots[slot];
+        uint8_t *dest = PIXEL_TABLE_ADDRESS + ( g_glyph_first - 128 + slot ) * GLYPH_SIZE;
+        const uint8_t *src = g_glyph_data + s->glyph * GLYPH_SIZE;
+
+        if ( g_glyph_bank == BANK_NONE )
+            vram_copy( dest, src, GLYPH_SIZE );
+        else
+            bank_copy( g_glyph_bank, dest, src, GLYPH_SIZE );
+        s->queued = false;
+    }
+
+    // The rest go next blank
+    g_glyph_queued -= count;
+    memmove( g_glyph_queue, g_glyph_queue + count, g_glyph_queued );
+}
+
+#if VDU_DEMO
+///< Sprites drawn each frame by frame_run(), set by the game
+Sprite g_sprites[SPRITE_MAX];
+
+///< Cells each sprite was drawn on, on each page
+static SpriteCells g_sprite_drawn[2][SPRITE_MAX];
+
+///< Sprites left out by the glyph budget last time on each page, drawn first next time
+static uint8_t g_sprite_late[2];
+
+///< Offsets of a sprite's cells from its top left, in the order of its glyphs
+static const uint8_t g_sprite_cell_offsets[4] = { 0, VDU_COLUMNS, 1, VDU_COLUMNS + 1 };
+
+///< Under rom characters, which have no pcg glyph to show through
+static const uint8_t g_sprite_blank[GLYPH_SIZE] = { 0 };
+
+///< Whether a sprite left out on this page still shows on a cell
+static bool sprite_late_covers( const SpriteCells *drawn, uint8_t late, uint16_t cell ) {
+
+    for( uint8_t i = 0; late; i++, late >>= 1 ) {
+
+        if ( !( late & 1 ) )
+            continue;
+        for( uint8_t c = 0; c < 4; c++ ) {
+
+            if ( ( drawn[i].cells & ( 1 << c ) ) && drawn[i].offset + g_sprite_cell_offsets[c] == cell )
+                return true;
+        }
+    }
+    return false;
+}
+
+///< Draw the sprites on the draw page, after vdu_shadow_flush()
+///< Each page has its own sprite tiles, so the glyphs are composed straight
+///< into pcg ram while the other page is shown, with nothing left for the
+///< vertical blank. The shadow screen is the background: the cells a sprite
+///< covered on this page are put back from it first. Sprites are drawn in
+///< tile row order, lower ones in front. Past SPRITE_GLYPHS_MAX a sprite is
+///< left where it was on this page, and goes first next time. The cells it
+///< still shows on are not put back for the others.
+void sprite_draw() {
+
+    uint8_t page = g_vdu_draw_page / VDU_PAGE_SIZE;
+    uint8_t *tiles = vdu_draw_tiles();
+    uint8_t *colours = vdu_draw_colours();
+    SpriteCells *drawn = g_sprite_drawn[page];
+    uint8_t order[SPRITE_MAX];
+    uint8_t count = 0;
+    uint8_t visible = 0;
+    uint8_t drawing;
+    uint8_t late;
+
+    for( uint8_t i = 0; i < SPRITE_MAX; i++ ) {
+
+        uint8_t row = g_sprites[i].y / 16;
+        uint8_t j;
+
+        if ( !g_sprites[i].image )
+            continue;
+        visible |= 1 << i;
+
+        for( j = count++; j && g_sprites[order[j - 1]].y / 16 > row; j-- )
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    drawing = visible;
+    if ( count > SPRITE_GLYPHS_MAX / 4 ) {
+
+        uint8_t waited = g_sprite_late[page];
+        uint8_t budget = SPRITE_GLYPHS_MAX / 4;
+
+        drawing = 0;
+        for( uint8_t pass = 0; pass < 2; pass++ ) {
+
+            for( uint8_t j = 0; j < count && budget; j++ ) {
+
+                uint8_t bit = 1 << order[j];
+
+                if ( ( drawing & bit ) || ( !pass && !( waited & bit ) ) )
+                    continue;
+                drawing |= bit;
+                budget--;
+            }
+        }
+    }
+    late = visible & ~drawing;
+    g_sprite_late[page] = late;
+
+    vdu_bank(1);
+    for( uint8_t i = 0; i < SPRITE_MAX; i++ ) {
+
+        SpriteCells *d = &drawn[i];
+
+        if ( !d->cells || ( late & ( 1 << i ) ) )
+            continue;
+
+        for( uint8_t c = 0; c < 4; c++ ) {
+
+            if ( d->cells & ( 1 << c ) ) {
+
+                uint16_t cell = d->offset + g_sprite_cell_offsets[c];
+                if ( late && sprite_late_covers( drawn, late, cell ) )
+                    continue;
+                tiles[cell] = g_vdu_tiles[cell];
+                colours[cell] = g_vdu_colours[cell];
+            }
+        }
+        d->cells = 0;
+    }
+
+    for( uint8_t j = 0; j < count; j++ ) {
+
+        uint8_t i = order[j];
+        Sprite *s = &g_sprites[i];
+        uint16_t x = s->x < SPRITE_X_MAX ? s->x : SPRITE_X_MAX;
+        uint8_t y = s->y < SPRITE_Y_MAX ? s->y : SPRITE_Y_MAX;
+        uint16_t offset = vdu_row_offset( y / 16 ) + x / 8;
+        uint8_t tile = SPRITE_TILE_FIRST + ( page * SPRITE_MAX + i ) * 4;
+        uint8_t cells = 1;
+        const uint8_t *backgrounds[4];
+
+        if ( !( drawing & ( 1 << i ) ) )
+            continue;
+
+        // Only the cells the sprite reaches, so it stays on screen
+        if ( y % 16 )
+            cells |= 2;
+        if ( x % 8 )
+            cells |= cells << 2;
+
+        // What is on the page under it, a sprite drawn already included
+        for( uint8_t c = 0; c < 4; c++ ) {
+
+            backgrounds[c] = g_sprite_blank;
+            if ( cells & ( 1 << c ) ) {
+
+                uint8_t under = tiles[offset + g_sprite_cell_offsets[c]];
+                if ( under >= 128 )
+                    backgrounds[c] = PIXEL_TABLE_ADDRESS + ( under - 128 ) * GLYPH_SIZE;
+            }
+        }
+
+        vdu_bank(0);
+        if ( s->code )
+            sprite_compose_code( PIXEL_TABLE_ADDRESS + ( tile - 128 ) * GLYPH_SIZE, backgrounds,
+                s->code[x % 8], y % 16 );
+        else
+            sprite_compose( PIXEL_TABLE_ADDRESS + ( tile - 128 ) * GLYPH_SIZE, backgrounds,
+                s->image + ( x % 8 ) * SPRITE_SHIFT_SIZE, y % 16 );
+        vdu_bank(1);
+
+        for( uint8_t c = 0; c < 4; c++ ) {
+
+            if ( cells & ( 1 << c ) ) {
+
+                uint16_t cell = offset + g_sprite_cell_offsets[c];
+                tiles[cell] = tile + c;
+                colours[cell] = s->colour;
+            }
+        }
+        drawn[i].offset = offset;
+        drawn[i].cells = cells;
+    }
+    vdu_bank(0);
+}
+
+///< Scrolling tile map, shown in place of the pages while g_tilemap_world is set
+///< World column w of row r is always at cell ( g_tilemap_origin + w + r * 64 ) & VDU_RAM_MASK,
+///< so scrolling only moves the display start, and a column coming on to the
+///< screen goes in the cells of the one that just went off the other side
+const uint8_t *g_tilemap_world;         // From pack/beepack -w, 0 for the pages
+uint16_t g_tilemap_columns;             // Width of the world
+uint16_t g_tilemap_column;              // World column at the left of the screen
+static const uint8_t *g_tilemap_colours; // Colour of each tile
+static uint16_t g_tilemap_origin;
+static int16_t g_tilemap_scroll;        // Columns still to go, from tilemap_scroll()
+static uint16_t g_tilemap_chunk = TILEMAP_NONE; // Unpacked at TILEMAP_BUFFER_ADDRESS
+static uint8_t g_tilemap_stage[TILEMAP_STEPS_MAX][VDU_ROWS * 2]; // Tiles then colours of columns to write
+
+///< Tiles of a world column, unpacking its chunk if it isn't in
+static const uint8_t *tilemap_column_tiles( uint16_t column ) {
+
+    const uint16_t *chunks = (const uint16_t*)g_tilemap_world + 1;
+    uint16_t chunk = column / TILEMAP_CHUNK_COLUMNS;
+
+    if ( chunk != g_tilemap_chunk ) {
+
+        lz_unpack( TILEMAP_BUFFER_ADDRESS, g_tilemap_world + chunks[chunk] );
+        g_tilemap_chunk = chunk;
+    }
+
+    return TILEMAP_BUFFER_ADDRESS + ( column % TILEMAP_CHUNK_COLUMNS ) * VDU_ROWS;
+}
+
+///< Get a world column's tiles and colours ready to write
+static void tilemap_column_stage( uint8_t *stage, uint16_t column ) {
+
+    const uint8_t *tiles = tilemap_column_tiles( column );
+
+    for( uint8_t row = 0; row < VDU_ROWS; row++ ) {
+
+        stage[row] = tiles[row];
+        stage[VDU_ROWS + row] = g_tilemap_colours[tiles[row]];
+    }
+}
+
+///< Write a staged column to its cells, with colour ram switched in
+static void tilemap_column_write( const uint8_t *stage, uint16_t column ) {
+
+    uint16_t cell = g_tilemap_origin + column;
+
+    for( uint8_t row = 0; row < VDU_ROWS; row++, cell += VDU_COLUMNS ) {
+
+        cell &= VDU_RAM_MASK;
+        TILE_TABLE_ADDRESS[cell] = stage[row];
+        COLOUR_TABLE_ADDRESS[cell] = stage[VDU_ROWS + row];
+    }
+}
+
+///< Show a world from pack/beepack -w from a column, in place of the pages
+///< colours has the colour of each tile. The screen is drawn on the draw page
+///< straight away, with a chunk unpacked every 16 columns, so call it
+///< between screens. The next flip shows it.
+void tilemap_start( const uint8_t *world, const uint8_t *colours, uint16_t column ) {
+
+    g_tilemap_world = world;
+    g_tilemap_colours = colours;
+    g_tilemap_columns = *(const uint16_t*)world;
+    g_tilemap_column = column;
+    g_tilemap_scroll = 0;
+    g_tilemap_chunk = TILEMAP_NONE;
+    g_tilemap_origin = ( g_vdu_draw_page - column ) & VDU_RAM_MASK;
+
+    for( uint8_t i = 0; i < VDU_COLUMNS; i++ ) {
+
+        tilemap_column_stage( g_tilemap_stage[0], column + i );
+        vdu_bank(1);
+        tilemap_column_write( g_tilemap_stage[0], column + i );
+        vdu_bank(0);
+    }
+}
+
+///< Back to the pages, both are drawn again from the shadow screen
+void tilemap_stop() {
+
+    g_tilemap_world = 0;
+    vdu_span_mark( g_vdu_tile_spans, 0, VDU_PAGE_SIZE );
+    vdu_span_mark( g_vdu_colour_spans, 0, VDU_PAGE_SIZE );
+}
+
+///< Scroll the world by columns, negative to the left, stopping at its ends
+///< Up to TILEMAP_STEPS_MAX go each frame, the rest the frames after
+void tilemap_scroll( int16_t columns ) {
+
+    int16_t to = g_tilemap_column + g_tilemap_scroll + columns;
+    int16_t last = g_tilemap_columns - VDU_COLUMNS;
+
+    if ( to < 0 )
+        to = 0;
+    if ( to > last )
+        to = last;
+    g_tilemap_scroll = to - g_tilemap_column;
+}
+
+///< Scroll in the vertical blank, called by frame_run() in place of vdu_flip()
+///< The columns coming on are unpacked before the blank. In it the display
+///< start moves and they are written over the ones that went off, well
+///< before the blank ends and the frame starts.
+///< Returns the time waited for the blank in sound slots
+uint16_t tilemap_flip() {
+
+    int16_t steps = g_tilemap_scroll;
+    uint16_t column = g_tilemap_column;
+    uint16_t slots, start;
+
+    if ( steps > TILEMAP_STEPS_MAX )
+        steps = TILEMAP_STEPS_MAX;
+    if ( steps < -TILEMAP_STEPS_MAX )
+        steps = -TILEMAP_STEPS_MAX;
+
+    // Past the right edge going right, before the left edge going left
+    if ( steps > 0 )
+        column += VDU_COLUMNS;
+    else
+        column -= 1;
+    for( int8_t i = 0; i < steps; i++ )
+        tilemap_column_stage( g_tilemap_stage[i], column + i );
+    for( int8_t i = 0; i < -steps; i++ )
+        tilemap_column_stage( g_tilemap_stage[i], column - i );
+
+    slots = vdu_vsync_wait();
+
+    g_tilemap_column += steps;
+    g_tilemap_scroll -= steps;
+    start = ( g_tilemap_origin + g_tilemap_column ) & VDU_RAM_MASK;
+    vdu_reg_set( crtDisplayStartAddressHigh, start >> 8 );
+    vdu_reg_set( crtDisplayStartAddressLow, start & 0xff );
+
+    vdu_bank(1);
+    for( int8_t i = 0; i < steps; i++ )
+        tilemap_column_write( g_tilemap_stage[i], column + i );
+    for( int8_t i = 0; i < -steps; i++ )
+        tilemap_column_write( g_tilemap_stage[i], column - i );
+    vdu_bank(0);
+
+    return slots;
+}
+
+#endif
+
 ///< Clear screen
+///< Tiles, both pages, and pcg ram, about 24600 T-states
 void vdu_screen_clear() {
 
-    memset( TILE_TABLE_ADDRESS, 32, 4096 );
+    vram_fill( TILE_TABLE_ADDRESS, 4096, 32 );
 }
 
 ///< Setup vdu
 void vdu_init() {
 
     vdu_screen_clear();
+#if VDU_DEMO
+    vram_fill_rows( g_vdu_tiles, VDU_ROWS, 32 );
+#endif
     vdu_crt_setup();
 }
 
@@ -180,6 +1106,242 @@ __asm
 __endasm;
 }
 
+#define KEY_COUNT 64                    // Keyboard is wired to update address bits 4-9
+#define KEY_MAP_SIZE ( KEY_COUNT / 8 )
+
+///< Keyboard matrix positions, '@', 'A'-'Z' and '[' to '^' are their ascii code & 0x3f
+enum {
+
+    keyEscape = 48,
+    keyBackspace,
+    keyTab,
+    keyLineFeed,
+    keyReturn,
+    keyLock,
+    keyBreak,
+    keySpace,
+    keyUp,
+    keyCtrl,
+    keyDown,
+    keyLeft,
+    keyRight = 62,
+    keyShift,
+};
+
+///< Key bitmaps, key n is bit ( n & 7 ) of byte n / 8
+uint8_t g_keys[KEY_MAP_SIZE];           // Down at the last scan
+uint8_t g_keys_pressed[KEY_MAP_SIZE];   // Went down at the last scan
+uint8_t g_keys_released[KEY_MAP_SIZE];  // Went up at the last scan
+
+#define key_down( key ) ( g_keys[( key ) >> 3] & ( 1 << ( ( key ) & 7 ) ) )
+#define key_pressed( key ) ( g_keys_pressed[( key ) >> 3] & ( 1 << ( ( key ) & 7 ) ) )
+#define key_released( key ) ( g_keys_released[( key ) >> 3] & ( 1 << ( ( key ) & 7 ) ) )
+
+///< Reading the light pen address clears the light pen (key hit) flag
+static void vdu_light_pen_clear() {
+
+    CrtRegPort = crtLightPenHigh;
+    (void)CrtDataPort;
+}
+
+///< Scan 8 keys from key, returns a bit per key with key in bit 0
+///< The latch rom must be on and the light pen flag clear
+static uint8_t keyboard_scan_row( uint8_t key ) __naked __z88dk_fastcall {
+
+    key;
+__asm
+    ; the hiword (register 0x12) is the same for the 8 keys
+    ld      a,#0x12
+    out     (#0x0c),a
+    ld      a,l
+    rrca
+    rrca
+    rrca
+    rrca
+    and     #0x03
+    out     (#0x0d),a
+
+    ld      c,l                 ; c = key
+    ld      b,#8
+    ld      e,#0                ; e = keys down
+
+00001$:
+    ; write the loword to register 0x13 (19)
+    ld      a,#0x13
+    out     (#0x0c),a
+    ld      a,c
+    rlca
+    rlca
+    rlca
+    rlca
+    out     (#0x0d),a
+
+    ; write to port 31 to scan the key
+    ld      a,#0x1f
+    out     (#0x0c),a
+    out     (#0x0d),a
+
+    ; wait for update strobe bit to be set
+00002$:     in      a,(#0x0c)
+    rla
+    jr      nc,00002$
+
+    ; light pen bit into e, the first key ends up in bit 0
+    in      a,(#0x0c)
+    rla
+    rla
+    rr      e
+    bit     #7,e
+    jr      z,00003$
+
+    ; clear the light pen flag for the next key
+    ld      a,#0x10
+    out     (#0x0c),a
+    in      a,(#0x0d)
+
+00003$:
+    inc     c
+    djnz    00001$
+
+    ;; return in both a and l, either abi
+    ld      a,e
+    ld      l,e
+    ret
+__endasm;
+}
+
+///< Scan a single key, as keyboard_scan_row()
+static bool keyboard_scan_key( uint8_t key ) __naked __z88dk_fastcall {
+
+    key;
+__asm
+    ; write the loword to register 0x12 (18)
+    ld      a,#0x12
+    out     (#0x0c),a
+    ld      a,l
+    rrca
+    rrca
+    rrca
+    rrca
+    and     #0x03
+    out     (#0x0d),a
+
+    ; write the hiword to register 0x13 (19)
+    ld      a,#0x13
+    out     (#0x0c),a
+    ld      a,l
+    rlca
+    rlca
+    rlca
+    rlca
+    out     (#0x0d),a
+
+    ; write to port 31 to scan the key
+    ld      a,#0x1f
+    out     (#0x0c),a
+    out     (#0x0d),a
+
+    ; wait for update strobe bit to be set
+00001$:     in      a,(#0x0c)
+    rla
+    jr      nc,00001$
+
+    ; read status register and check lpen bit
+    in      a,(#0x0c)
+    ld      l,#0
+    and     #0x40
+    ret     z
+
+    ; clear the light pen flag for the next key
+    ld      a,#0x10
+    out     (#0x0c),a
+    in      a,(#0x0d)
+
+    ld      a,#1
+    ld      l,a
+    ret
+__endasm;
+}
+
+///< True if no key was down at the last scan and none has been hit since
+///< The display refresh scans the keyboard too, setting the light pen flag
+///< when it finds a key down, so a scan can be skipped until then
+static bool keyboard_idle() {
+
+    uint8_t any = 0;
+
+    for( uint8_t i = 0; i < KEY_MAP_SIZE; i++ )
+        any |= g_keys[i];
+
+    return !any && !( CrtRegPort & ( 1 << crtStatusLightPen ) );
+}
+
+///< Scan the whole keyboard into the key bitmaps
+///< One pass over the 64 keys, with the latch rom switched and the light
+///< pen cleared once rather than for every key as is_key_down() does
+void keyboard_scan() {
+
+    memset( g_keys_pressed, 0, KEY_MAP_SIZE );
+    memset( g_keys_released, 0, KEY_MAP_SIZE );
+
+    if ( keyboard_idle() )
+        return;
+
+    // enable latch rom (to disable key scan by the display refresh)
+    LatchRomPort = 1;
+    vdu_light_pen_clear();
+
+    for( uint8_t i = 0; i < KEY_MAP_SIZE; i++ ) {
+
+        uint8_t down = keyboard_scan_row( i * 8 );
+
+        g_keys_pressed[i] = down & ~g_keys[i];
+        g_keys_released[i] = g_keys[i] & ~down;
+        g_keys[i] = down;
+    }
+
+    LatchRomPort = 0;
+    vdu_light_pen_clear();
+}
+
+///< Scan only the keys a game uses, the other keys are left as they were
+///<     static const uint8_t game_keys[] = { keyLeft, keyRight, keySpace };
+///<     keyboard_scan_keys( game_keys, sizeof( game_keys ) );
+void keyboard_scan_keys( const uint8_t *keys, uint8_t count ) {
+
+    memset( g_keys_pressed, 0, KEY_MAP_SIZE );
+    memset( g_keys_released, 0, KEY_MAP_SIZE );
+
+    if ( keyboard_idle() )
+        return;
+
+    LatchRomPort = 1;
+    vdu_light_pen_clear();
+
+    while( count-- ) {
+
+        uint8_t key = *keys++ & ( KEY_COUNT - 1 );
+        uint8_t index = key >> 3;
+        uint8_t bit = 1 << ( key & 7 );
+
+        if ( keyboard_scan_key( key ) ) {
+
+            if ( !( g_keys[index] & bit ) )
+                g_keys_pressed[index] |= bit;
+            g_keys[index] |= bit;
+        }
+        else {
+
+            if ( g_keys[index] & bit )
+                g_keys_released[index] |= bit;
+            g_keys[index] &= ~bit;
+        }
+    }
+
+    LatchRomPort = 0;
+    vdu_light_pen_clear();
+}
+
 int g_seed = 1;
 
 ///< Random number
@@ -220,18 +1382,71 @@ uint16_t fast_rand() __naked {
     return 0;
 }
 
+#if VDU_DEMO
+///< Tile of each glyph test cell, 0 before the first glyph
+static uint8_t g_glyph_test_tiles[GLYPH_TEST_CELLS];
+
+///< Give a cell of GLYPH_TEST_ROW a random glyph of the 256 through the cache
+///< Some are still cached, the rest take the oldest unused slot and upload
+static void glyph_test_cell( uint8_t cell ) {
+
+    uint8_t *tile = &g_glyph_test_tiles[cell];
+
+    if ( *tile )
+        glyph_release( *tile );
+    *tile = glyph_acquire( fast_rand() );
+    vdu_tiles_fill( vdu_row_offset( GLYPH_TEST_ROW ) + cell, *tile, 1 );
+}
+
 ///< Random stuff of on screen
+///< The whole screen once, after that only a few cells change each pass
+///< and only those are copied to the screen
 void display_test() {
-    
-    uint8_t *ptr = TILE_TABLE_ADDRESS;
-    uint16_t size = 0x400;
 
-    // User defined tiles are at 128-255
-    for( int i = 0; i < size / 2; i++ )
-        *ptr++ = ( fast_rand() % 64 ) + 128;
-    // Fixed ascii tiles are at 0-127
-    for( int i = 0; i < size / 2; i++ )
-        *ptr++ = ( fast_rand() % 64 );
+    static bool drawn = false;
+
+    if ( drawn ) {
+
+        for( uint8_t i = 0; i < DISPLAY_TEST_CHANGES; i++ ) {
+
+            // Leave the title on the bottom half, the frame meter's row and the glyph test's
+            uint16_t offset = fast_rand() % ( VDU_PAGE_SIZE / 2 );
+            uint8_t row = vdu_offset_row( offset );
+            if ( row == FRAME_METER_ROW || row == GLYPH_TEST_ROW )
+                continue;
+
+            vdu_tiles_fill( offset, ( fast_rand() % 32 ) + 128, 1 );
+            vdu_colours_fill( offset, fast_rand(), 1 );
+        }
+        for( uint8_t i = 0; i < GLYPH_TEST_CHANGES; i++ )
+            glyph_test_cell( fast_rand() % GLYPH_TEST_CELLS );
+        return;
+    }
+    drawn = true;
+
+    uint8_t *ptr = g_vdu_tiles;
+    uint16_t size = VDU_PAGE_SIZE;
+
+    // User defined tiles are at 128-255, the random ones at 128-159
+    for( uint16_t i = 0; i < size / 2; i++ )
+        *ptr++ = ( fast_rand() % 32 ) + 128;
+    // Fixed ascii tiles are at 0-127, the title is in them
+    bank_asset_copy( &g_title_asset, ptr );
+    // A line under it from the title overlay, when run from cp/m
+    if ( overlay_load( "TITLE   OVL" ) )
+        overlay_run();
+
+    // Colour data
+    // Colour data is set directly to the screen, and does not effect tiles
+
+    // Random colours
+    ptr = g_vdu_colours;
+    for( uint16_t i = 0; i < size / 2; i++ )
+        *ptr++ = fast_rand();
+    vram_fill_rows( ptr, VDU_ROWS / 2, 0x0f );
+
+    vdu_span_mark( g_vdu_tile_spans, 0, VDU_PAGE_SIZE );
+    vdu_span_mark( g_vdu_colour_spans, 0, VDU_PAGE_SIZE );
 
     // Pixel pattern data
     // Pixel data applied to the tiles,
@@ -243,82 +1458,437 @@ void display_test() {
     // Random pixels
     ptr = PIXEL_TABLE_ADDRESS;
     size = 0x800;
-    for( int i = 0; i < size; i++ )
+    for( uint16_t i = 0; i < size; i++ )
         *ptr++ = fast_rand();
 
-    // Colour data
-    // Colour data is set directly to the screen, and does not effect tiles
-
-    // Use colour memory bank
-    vdu_bank(1);
+    // Some real glyphs among them
+    bank_asset_copy( &g_glyph_asset, PIXEL_TABLE_ADDRESS );
 
-    // Random colours
-    ptr = PIXEL_TABLE_ADDRESS;
-    size = 0x800;
-    for( int i = 0; i < size; i++ )
-        *ptr++ = fast_rand();
+    // More glyphs than the cache has tiles, uploaded by frame_run()
+    for( uint8_t cell = 0; cell < GLYPH_TEST_CELLS; cell++ )
+        glyph_test_cell( cell );
 }
+#endif
 
-///< Methods of producing 1 bit sound
-void sound_test() {
+///< Sound channels, silent until sound_play()
+SoundChannel g_sound_channels[SOUND_CHANNELS];
 
-    // Pulse width modulation (PWM) (10% on / 90% off)
-    // Using shorter pulses, but at a set wave length,
-    // it's possible to have multiple channels, but gives a buzzing quality
-    for( int i = 0; i < 200; i++ ) {
+///< Noise lfsr stepped by sound_render(), must not be 0
+uint16_t g_sound_random = 1;
+
+///< Start an effect on a free channel, or take the lowest priority one playing
+///< Returns straight away, false if every channel has something more important
+bool sound_play( const SoundEffect *effect ) {
 
-        SoundPort = SOUND_MASK;
-        for( int delay = 0; delay < 2; delay++ );
-        SoundPort = 0;
-        for( int delay = 0; delay < 200; delay++ );
+    SoundChannel *channel = g_sound_channels;
+    SoundChannel *best = 0;
+
+    for( uint8_t i = 0; i < SOUND_CHANNELS; i++, channel++ ) {
+
+        if ( !channel->frames ) {
+
+            best = channel;
+            break;
+        }
+        if ( channel->priority <= effect->priority && ( !best || channel->priority < best->priority ) )
+            best = channel;
     }
 
-    // Pure (50% on / 50% off).
-    // A clear sound, but multiple channels is difficult.
-    for( int i = 0; i < 200; i++ ) {
+    if ( !best )
+        return false;
+
+    best->step = effect->step;
+    best->sweep = effect->sweep;
+    best->priority = effect->priority;
+    best->frames = effect->frames;
+    best->threshold = effect->type == soundPwm ? effect->duty : effect->type == soundNoise ? 0xff : 0x7f;
+    best->noise = effect->type == soundNoise ? 0xff : 0;
+    best->pattern = 0x80;
+
+    return true;
+}
 
-        SoundPort = SOUND_MASK;
-        for( int delay = 0; delay < 50; delay++ );
-        SoundPort = 0;
-        for( int delay = 0; delay < 50; delay++ );
+///< Once a frame, play the music, sweep the pitch and silence channels that have finished
+///< Returns the T-states the music player took this frame
+uint16_t sound_frame() {
+
+    SoundChannel *channel = g_sound_channels;
+    uint16_t music = music_frame();
+
+    for( uint8_t i = 0; i < SOUND_CHANNELS; i++, channel++ ) {
+
+        if ( !channel->frames || channel->frames == SOUND_HOLD )
+            continue;
+
+        if ( --channel->frames ) {
+
+            channel->step += channel->sweep;
+        }
+        else {
+
+            channel->pattern = 0;
+            channel->noise = 0;
+            channel->priority = 0;
+        }
     }
 
+    return music;
+}
+
+///< Methods of producing 1 bit sound, queued a few frames apart
+void sound_test() {
+
+    // Pure (50% on / 50% off), falling like a laser
+    static const SoundEffect laser = { soundTone, 1, 20, SOUND_STEP( 1500 ), -SOUND_STEP( 60 ), 0 };
+
+    // Pulse width modulation (PWM) (10% on / 90% off)
+    // A thinner, buzzing sound under the others
+    static const SoundEffect buzz = { soundPwm, 0, 60, SOUND_STEP( 110 ), 0, 25 };
+
     // Noise. For explosions and shooting and the like.
-    for( int i = 0; i < 3000; i++ ) {
+    static const SoundEffect explosion = { soundNoise, 2, 25, SOUND_STEP( 1800 ), -SOUND_STEP( 50 ), 0 };
 
-        SoundPort = fast_rand() & SOUND_MASK;
+    static uint8_t frame = 0;
+
+    switch( frame++ ) {
+
+    case 0: sound_play( &buzz ); break;
+    case 20: sound_play( &laser ); break;
+    case 50: sound_play( &explosion ); break;
+    case 90: frame = 0; break;
     }
+
+    sound_frame();
 }
 
+#if VDU_DEMO
 void keyboard_test() {
 
     char keys[32] = "You Pressed  ";
 
+    keyboard_scan();
+
     // Punctuation tests as lower case
 
-    for( int key = 32; key < 256; key++ ) {
-        
-        if ( is_key_down( key ) ) {
+    for( uint8_t key = 0; key < KEY_COUNT; key++ ) {
 
-            keys[12] = key;
-            memcpy( TILE_TABLE_ADDRESS + 216, keys, strlen( keys ) );
-            vdu_bank(1);
-            memset( PIXEL_TABLE_ADDRESS + 216, 0x0f, strlen( keys ) );
+        if ( key_down( key ) ) {
+
+            // Show the key as its first code in 32-255 would
+            keys[12] = key < 32 ? key + 64 : key;
+            vdu_tiles_set( 216, (const uint8_t*)keys, strlen( keys ) );
+            vdu_colours_fill( 216, 0x0f, strlen( keys ) );
             break;
         }
     }
 }
 
+///< Sprites bouncing round the screen, in front of the display test
+///< The second half are drawn by compiled routines, so make bench-sprites
+///< compares the two
+void sprite_test() {
+
+    static int8_t dx[SPRITE_MAX];
+    static int8_t dy[SPRITE_MAX];
+    static bool started = false;
+    Sprite *s = g_sprites;
+
+    if ( !started ) {
+
+        started = true;
+        for( uint8_t i = 0; i < SPRITE_MAX; i++, s++ ) {
+
+            s->image = demo_sprites + ( i & 1 ) * SPRITE_IMAGE_SIZE;
+            s->code = i < SPRITE_MAX / 2 ? 0 : demo_sprite_code + ( i & 1 ) * 8;
+            s->x = fast_rand() % SPRITE_X_MAX;
+            s->y = fast_rand() % SPRITE_Y_MAX;
+            s->colour = 0x09 + i % 7;
+            dx[i] = i % 3 + 1;
+            dy[i] = i & 2 ? -1 : 1;
+        }
+        return;
+    }
+
+    for( uint8_t i = 0; i < SPRITE_MAX; i++, s++ ) {
+
+        int16_t x = s->x + dx[i];
+        int16_t y = s->y + dy[i];
+
+        if ( x < 0 || x > SPRITE_X_MAX ) {
+
+            dx[i] = -dx[i];
+            x = s->x + dx[i];
+        }
+        if ( y < 0 || y > SPRITE_Y_MAX ) {
+
+            dy[i] = -dy[i];
+            y = s->y + dy[i];
+        }
+        s->x = x;
+        s->y = y;
+    }
+}
+
+///< Colours of the world's tiles, foreground in the low nibble
+static const uint8_t g_world_colours[256] = {
+
+    ['#'] = 0x03,
+    ['"'] = 0x0a,
+    ['T'] = 0x02,
+    ['^'] = 0x07,
+    ['/'] = 0x07,
+    ['\\'] = 0x07,
+    ['~'] = 0x0f,
+    ['='] = 0x0e,
+    ['0'] = 0x0f, ['1'] = 0x0f, ['2'] = 0x0f, ['3'] = 0x0f,
+};
+
+///< Space swaps between the display test and a scrolling world, which
+///< scrolls a column a frame and turns at the ends, or with left and right
+///< Off without upper ram, which the world's chunks unpack to
+void world_test() {
+
+    static int8_t direction = 1;
+
+    if ( !g_upper_ram )
+        return;
+
+    if ( key_pressed( keySpace ) ) {
+
+        if ( g_tilemap_world )
+            tilemap_stop();
+        else
+            tilemap_start( world_demo, g_world_colours, 0 );
+    }
+    if ( !g_tilemap_world )
+        return;
+
+    if ( key_down( keyLeft ) )
+        direction = -1;
+    else if ( key_down( keyRight ) )
+        direction = 1;
+    else if ( g_tilemap_column == 0 )
+        direction = 1;
+    else if ( g_tilemap_column == g_tilemap_columns - VDU_COLUMNS )
+        direction = -1;
+
+    tilemap_scroll( direction );
+}
+#endif
+
+#if VDU_DEMO
+///< Frames counted by the vsync interrupt
+///< Stays 0 if pio port b bit 7 is linked to something other than vsync
+volatile uint16_t g_vsync_ticks;
+
+///< Vsync interrupt handler
+void vsync_tick() {
+
+    g_vsync_ticks++;
+}
+
+///< Lines of the last pass spent working rather than waiting for the blank
+///< More than FRAME_LINES when the pass ran over a frame
+uint16_t g_frame_lines;
+
+///< Render passes skipped to catch up
+uint16_t g_frame_skips;
+
+///< Show g_frame_lines as a bar across FRAME_METER_ROW
+bool g_frame_meter;
+
+///< Frames since the last call, counted by the vsync interrupt
+///< Without the interrupt every pass is one frame
+static uint8_t frame_elapsed() {
+
+    static uint16_t last;
+    uint16_t ticks;
+
+    // Read a byte at a time, so a tick in between could tear it. Called just
+    // after the blank started, a frame from the next tick, so it holds still
+    // the second time
+    do
+        ticks = g_vsync_ticks;
+    while( ticks != g_vsync_ticks );
+
+    uint16_t frames = ticks - last;
+
+    last += frames;
+    if ( !frames )
+        return 1;
+    return frames < FRAME_CATCH_UP ? frames : FRAME_CATCH_UP;
+}
+
+///< A column of the bar for each 64th of a frame, redrawn only when it changes
+static void frame_meter_draw() {
+
+    static uint8_t shown = 0xff;
+    uint16_t lines = g_frame_lines < FRAME_LINES ? g_frame_lines : FRAME_LINES;
+    uint8_t used = lines * VDU_COLUMNS / FRAME_LINES;
+    uint16_t offset = FRAME_METER_ROW * VDU_COLUMNS;
+
+    if ( used == shown )
+        return;
+    if ( shown == 0xff )
+        vdu_tiles_fill( offset, ' ', VDU_COLUMNS );
+    shown = used;
+
+    vdu_colours_fill( offset, FRAME_METER_COLOUR, used );
+    vdu_colours_fill( offset + used, 0, VDU_COLUMNS - used );
+}
+
+///< Run the game at a fixed step, synced to the vertical blank, never returns
+///< update runs once for each frame since the last pass, up to FRAME_CATCH_UP,
+///< so game time keeps up when a pass runs long. render is skipped once
+///< after a long pass to get back in step.
+void frame_run( void (*update)(), void (*render)() ) {
+
+    uint8_t frames = 1;
+    bool skipped = false;
+
+    for(;;) {
+
+        bool skip = frames > 1 && !skipped;
+
+        for( uint8_t i = 0; i < frames; i++ )
+            update();
+
+        if ( skip )
+            g_frame_skips++;
+        else
+            render();
+        skipped = skip;
+
+        if ( g_frame_meter )
+            frame_meter_draw();
+
+        uint16_t slots;
+        if ( g_tilemap_world ) {
+
+            slots = tilemap_flip();
+        }
+        else {
+
+            vdu_shadow_flush();
+            sprite_draw();
+            slots = vdu_flip();
+        }
+        glyph_cache_flush();
+
+        // The frames the pass took, less the wait
+        frames = frame_elapsed();
+        g_frame_lines = frames * FRAME_LINES - (uint16_t)( (uint32_t)slots * SOUND_SLOT_T / FRAME_LINE_T );
+    }
+}
+
+#ifdef FIXED_BENCH
+///< The fixed point routines and sdcc's own arithmetic on the same random
+///< numbers, a pair each frame, so make bench-fixed can compare them
+///< Only built for the bench, sdcc's 32 bit multiply and divide are too slow to keep
+void fixed_test() {
+
+    static uint8_t step = 0;
+    static volatile int32_t result;     // Kept, so each one is worked out
+    fixed8_t a = fast_rand();
+    fixed8_t b = fast_rand() | 1;
+
+    if ( !g_upper_ram )
+        return;
+
+    switch( step++ & 3 ) {
+
+    case 0:
+        result = fixed8_mul( a, b );
+        result = (int32_t)a * b >> 8;
+        break;
+    case 1:
+        result = fixed8_div( a, b );
+        result = ( (int32_t)a << 8 ) / b;
+        break;
+    case 2:
+        result = fixed_mul8( a, b );
+        result = (uint16_t)(uint8_t)a * (uint8_t)b;
+        result = fixed16_mul( (fixed16_t)a << 8, (fixed16_t)b << 8 );
+        break;
+    case 3:
+        result = fixed8_sin( a ) + fixed8_cos( a );
+        result = fixed_atan2( a, b );
+        break;
+    }
+}
+#endif
+
+///< Game logic, once a frame
+static void demo_update() {
+
+    keyboard_test();
+
+    sound_test();
+
+    sprite_test();
+
+    world_test();
+
+#ifdef FIXED_BENCH
+    fixed_test();
+#endif
+}
+
+///< Drawing, skipped when the demo falls behind
+static void demo_render() {
+
+    display_test();
+}
+
 void main() {
 
+    // Before anything else uses the upper 32K
+    g_upper_ram = upper_ram_test();
+    g_bank_count = bank_init();
+    bank_asset_load( &g_title_asset );
+    bank_asset_load( &g_glyph_asset );
+    if ( g_upper_ram )
+        fixed_init();
+
     vdu_init();
+    glyph_cache_init( GLYPH_TEST_DATA, BANK_NONE, GLYPH_TEST_FIRST, GLYPH_TEST_SLOTS );
+    music_play( song_demo );
 
-    for(;;) {
+    im2_init();
+    im2_handler_set( IM2_VECTOR_PIO_B, vsync_tick );
+    im2_vsync_enable();
 
-        display_test();
+    g_frame_meter = true;
+    frame_run( demo_update, demo_render );
+}
+#else
+///< The mode's screen, for a build in a mode other than the demo's
+///< A row number at the start of each row, a bar at the end and the mode's
+///< name in the middle, so the columns and rows can be seen to be all there
+void mode_test() {
+
+    static const char name[] = VDU_MODE_NAME;
 
-        keyboard_test();
+    vdu_bank(1);
+    vram_fill( COLOUR_TABLE_ADDRESS, VDU_PAGE_SIZE, 0x0f );
+    vdu_bank(0);
 
-        sound_test();
+    for( uint8_t row = 0; row < VDU_ROWS; row++ ) {
+
+        uint8_t *tile = vdu_tile_address( 0, row );
+        tile[0] = '0' + row / 10;
+        tile[1] = '0' + row % 10;
+        tile[VDU_COLUMNS - 1] = '|';
     }
+    vram_copy( vdu_tile_address( ( VDU_COLUMNS - sizeof( name ) + 1 ) / 2, VDU_ROWS / 2 ), (const uint8_t*)name, sizeof( name ) - 1 );
+}
+
+void main() {
+
+    vdu_init();
+    mode_test();
+
+    for(;;)
+        vdu_vsync_wait();
 }
+#endif
@@ -0,0 +1,156 @@
+;;; \file overlay_bee.s
+;;;
+;;; \brief Code overlays, loaded from disk through the cp/m bdos
+;;;
+;;; \copyright Copyright 2022 UnderM4hz
+;;; Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+;;; to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+;;; and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+;;; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;;; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+;;; WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;;;
+;;; Feel free to give credit
+;;;
+;;; An overlay is a module linked to run at OVERLAY_ADDRESS and written to
+;;; its own file by the Makefile. One is in at a time, up to the data at
+;;; OVERLAY_END, and its first function is its entry. It can call the
+;;; resident code but has no variables of its own.
+;;;
+;;; cp/m 2.2 has no multi-sector read, so each 128 byte record is read
+;;; straight to its place in the region by moving the dma address, with no
+;;; buffer or copy. Started from the boot tracks there is no bdos and no
+;;; overlays.
+;;;
+;;; Called from C as __sdcccall(0), see vram_bee.s.
+
+    .module overlay
+    .globl  _overlay_load
+
+BDOS = 0x0005                           ; jp bdos under cp/m
+BDOS_JP = 0xc3
+BDOS_OPEN = 15
+BDOS_READ = 20                          ; sequential, 0 in a when a record was read
+BDOS_SET_DMA = 26
+DEFAULT_DMA = 0x0080
+
+RECORD_SIZE = 128
+FCB_SIZE = 36
+FCB_NAME = 1                            ; after the drive, 0 for the default
+FCB_NAME_SIZE = 11
+
+OVERLAY_ADDRESS = 0x6000
+OVERLAY_END = 0x7000                    ; --data-loc
+
+    .area   _DATA
+
+overlay_name:
+    .ds     2                           ; of the overlay in, 0 for none
+overlay_fcb:
+    .ds     FCB_SIZE
+
+    .area   _CODE
+
+;;; bool overlay_load( const char *name )
+;;;
+;;; Load an overlay unless it is already in, name is the 11 character fcb
+;;; name such as "TITLE   OVL". Returns false without cp/m, or if the file
+;;; is missing or bigger than the region, which then holds no overlay.
+;;;
+;;; The same name pointer as the overlay in returns straight away, in 94
+;;; T-states. A load is a bdos call a record and takes disk time, call it
+;;; between screens rather than each frame.
+_overlay_load:
+    ld      hl, #2
+    add     hl, sp
+    ld      e, (hl)
+    inc     hl
+    ld      d, (hl)                     ; de = name
+
+    ld      hl, (overlay_name)
+    or      a, a
+    sbc     hl, de
+    ld      l, #1
+    ret     z
+
+    ld      a, (BDOS)
+    cp      a, #BDOS_JP
+    ld      l, #0
+    ret     nz
+
+    push    ix
+    push    iy
+    push    de
+
+    ; the region is about to change
+    ld      hl, #0
+    ld      (overlay_name), hl
+
+    ld      hl, #overlay_fcb
+    ld      de, #overlay_fcb + 1
+    ld      bc, #FCB_SIZE - 1
+    ld      (hl), #0
+    ldir
+    pop     hl
+    push    hl
+    ld      de, #overlay_fcb + FCB_NAME
+    ld      bc, #FCB_NAME_SIZE
+    ldir
+
+    ld      c, #BDOS_OPEN
+    ld      de, #overlay_fcb
+    call    BDOS
+    inc     a                           ; 0xff when not found
+    jr      z, 00004$
+
+    ld      hl, #OVERLAY_ADDRESS
+00001$:
+    push    hl
+    call    overlay_read
+    pop     hl
+    jr      nz, 00002$                  ; end of file
+    ld      de, #RECORD_SIZE
+    add     hl, de
+    ld      a, h
+    cp      a, #( OVERLAY_END >> 8 )
+    jr      c, 00001$
+
+    ; full, so the file has to end here
+    ld      hl, #DEFAULT_DMA
+    call    overlay_read
+    jr      z, 00003$                   ; too big
+
+00002$:
+    call    overlay_dma_reset
+    pop     hl
+    ld      (overlay_name), hl
+    ld      l, #1
+    jr      00005$
+
+00003$:
+    call    overlay_dma_reset
+00004$:
+    pop     hl
+    ld      l, #0
+
+00005$:
+    pop     iy
+    pop     ix
+    ret
+
+;;; Read the next record to hl, z when it was read, the dma is left at hl
+overlay_read:
+    ex      de, hl
+    ld      c, #BDOS_SET_DMA
+    call    BDOS
+    ld      c, #BDOS_READ
+    ld      de, #overlay_fcb
+    call    BDOS
+    or      a, a
+    ret
+
+;;; Put the dma back where cp/m programs expect it
+overlay_dma_reset:
+    ld      de, #DEFAULT_DMA
+    ld      c, #BDOS_SET_DMA
+    jp      BDOS
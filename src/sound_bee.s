@@ -0,0 +1,515 @@
+;;; \file sound_bee.s
+;;;
+;;; \brief 1 bit sound channels, played while waiting on the vertical blank
+;;;
+;;; \copyright Copyright 2022 UnderM4hz
+;;; Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+;;; to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+;;; and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+;;; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;;; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+;;; WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;;;
+;;; Feel free to give credit
+;;;
+;;; The channels take turns at the speaker in equal slots of 320 T-states, so
+;;; each is heard for a third of the time and its pitch only depends on the
+;;; clock. The channel state is SoundChannel in microbee.c, the offsets below
+;;; have to match it.
+
+    .module sound
+    .globl  _sound_render
+    .globl  _music_play
+    .globl  _music_frame
+    .globl  _g_sound_channels
+    .globl  _g_sound_random
+
+SOUND_PORT = 0x02
+SOUND_MASK = 0x60
+CRT_STATUS_PORT = 0x0c
+VDU_VSYNC_MASK = 0x20
+
+SOUND_PHASE = 0                         ; uint16_t, wraps once a period
+SOUND_STEP = 2                          ; uint16_t, added to phase each slot
+SOUND_THRESHOLD = 4                     ; uint8_t, on while phase high byte is at or below
+SOUND_PATTERN = 5                       ; uint8_t, bit 7 gates the speaker
+SOUND_NOISE = 6                         ; uint8_t, 0xff flips bit 7 of pattern at random
+SOUND_PRIORITY = 7                      ; uint8_t
+SOUND_FRAMES = 8                        ; uint8_t, frames left, 0 is free
+SOUND_HOLD = 0xff                       ; frames of a channel the music has
+SOUND_SWEEP = 9                         ; int16_t, added to step each frame
+SOUND_CHANNEL_SIZE = 11
+
+MUSIC_PRIORITY = 0x80                   ; Effects below this leave the music channels alone,
+                                        ; the music leaves effects at or above it
+MUSIC_CHANNEL0 = _g_sound_channels
+MUSIC_CHANNEL1 = _g_sound_channels+SOUND_CHANNEL_SIZE
+
+; T-states of each path through music_frame(), including the call from C
+MUSIC_IDLE_T = 65
+MUSIC_STOPPED_T = 105
+MUSIC_ROW_T = 1101
+MUSIC_PATTERN_T = 242                   ; on top of MUSIC_ROW_T
+
+    .area   _DATA
+
+music_song:
+    .ds     2                           ; 0 when stopped
+music_row:
+    .ds     2                           ; next row to play
+music_order:
+    .ds     1                           ; order list entry playing
+music_rows:
+    .ds     1                           ; rows left in the pattern
+music_wait:
+    .ds     1                           ; frames to the next row
+music_notes:
+    .ds     2                           ; note on each channel, for holds
+music_t:
+    .ds     2                           ; cost of this frame
+music_spare:
+    .ds     SOUND_CHANNEL_SIZE          ; takes the rows of a channel an effect has
+
+    .area   _CODE
+
+;;; uint16_t sound_render( uint16_t vsync )
+;;;
+;;; Play the channels while the crt vsync status bit is vsync (0 or
+;;; VDU_VSYNC_MASK), returns within one slot of it changing. Returns the
+;;; slots played, the time spent waiting is that times 320 T-states.
+;;;
+;;; 960 T-states for all three channels, 3516 Hz a channel. The slot count
+;;; is kept in bc', which sdcc never uses.
+_sound_render:
+    ld      hl, #2
+    add     hl, sp
+    ld      c, (hl)                     ; c = vsync
+    exx
+    ld      bc, #0
+    exx
+
+sound_slot0:
+    ; phase += step, carry on a new period
+    ld      hl, (_g_sound_channels+SOUND_PHASE)
+    ld      de, (_g_sound_channels+SOUND_STEP)
+    add     hl, de
+    ld      (_g_sound_channels+SOUND_PHASE), hl
+
+    ; a new period of a noise channel flips pattern bit 7 at random
+    sbc     a, a
+    ld      e, a
+    ld      a, (_g_sound_channels+SOUND_NOISE)
+    and     a, e
+    ld      e, a
+    ld      a, (_g_sound_random)
+    and     a, e
+    ld      e, a
+    ld      a, (_g_sound_channels+SOUND_PATTERN)
+    xor     a, e
+    ld      (_g_sound_channels+SOUND_PATTERN), a
+
+    ; speaker on while pattern bit 7 is set and phase is at or below threshold
+    ld      b, a
+    ld      a, (_g_sound_channels+SOUND_THRESHOLD)
+    cp      a, h
+    sbc     a, a
+    cpl
+    and     a, b
+    rlca
+    sbc     a, a
+    and     a, #SOUND_MASK
+    out     (#SOUND_PORT), a
+
+    exx
+    inc     bc                          ; slots played
+    exx
+
+    ; 16 bit galois lfsr for the noise
+    ld      hl, (_g_sound_random)
+    add     hl, hl
+    sbc     a, a
+    and     a, #0x2d
+    xor     a, l
+    ld      l, a
+    ld      (_g_sound_random), hl
+
+    in      a, (#CRT_STATUS_PORT)
+    and     a, #VDU_VSYNC_MASK
+    cp      a, c
+    jp      nz, sound_render_done
+    jp      sound_slot1
+
+sound_slot1:
+    ; phase += step, carry on a new period
+    ld      hl, (_g_sound_channels+SOUND_CHANNEL_SIZE+SOUND_PHASE)
+    ld      de, (_g_sound_channels+SOUND_CHANNEL_SIZE+SOUND_STEP)
+    add     hl, de
+    ld      (_g_sound_channels+SOUND_CHANNEL_SIZE+SOUND_PHASE), hl
+
+    ; a new period of a noise channel flips pattern bit 7 at random
+    sbc     a, a
+    ld      e, a
+    ld      a, (_g_sound_channels+SOUND_CHANNEL_SIZE+SOUND_NOISE)
+    and     a, e
+    ld      e, a
+    ld      a, (_g_sound_random)
+    and     a, e
+    ld      e, a
+    ld      a, (_g_sound_channels+SOUND_CHANNEL_SIZE+SOUND_PATTERN)
+    xor     a, e
+    ld      (_g_sound_channels+SOUND_CHANNEL_SIZE+SOUND_PATTERN), a
+
+    ; speaker on while pattern bit 7 is set and phase is at or below threshold
+    ld      b, a
+    ld      a, (_g_sound_channels+SOUND_CHANNEL_SIZE+SOUND_THRESHOLD)
+    cp      a, h
+    sbc     a, a
+    cpl
+    and     a, b
+    rlca
+    sbc     a, a
+    and     a, #SOUND_MASK
+    out     (#SOUND_PORT), a
+
+    exx
+    inc     bc                          ; slots played
+    exx
+
+    ; 16 bit galois lfsr for the noise
+    ld      hl, (_g_sound_random)
+    add     hl, hl
+    sbc     a, a
+    and     a, #0x2d
+    xor     a, l
+    ld      l, a
+    ld      (_g_sound_random), hl
+
+    in      a, (#CRT_STATUS_PORT)
+    and     a, #VDU_VSYNC_MASK
+    cp      a, c
+    jp      nz, sound_render_done
+    jp      sound_slot2
+
+sound_slot2:
+    ; phase += step, carry on a new period
+    ld      hl, (_g_sound_channels+SOUND_CHANNEL_SIZE*2+SOUND_PHASE)
+    ld      de, (_g_sound_channels+SOUND_CHANNEL_SIZE*2+SOUND_STEP)
+    add     hl, de
+    ld      (_g_sound_channels+SOUND_CHANNEL_SIZE*2+SOUND_PHASE), hl
+
+    ; a new period of a noise channel flips pattern bit 7 at random
+    sbc     a, a
+    ld      e, a
+    ld      a, (_g_sound_channels+SOUND_CHANNEL_SIZE*2+SOUND_NOISE)
+    and     a, e
+    ld      e, a
+    ld      a, (_g_sound_random)
+    and     a, e
+    ld      e, a
+    ld      a, (_g_sound_channels+SOUND_CHANNEL_SIZE*2+SOUND_PATTERN)
+    xor     a, e
+    ld      (_g_sound_channels+SOUND_CHANNEL_SIZE*2+SOUND_PATTERN), a
+
+    ; speaker on while pattern bit 7 is set and phase is at or below threshold
+    ld      b, a
+    ld      a, (_g_sound_channels+SOUND_CHANNEL_SIZE*2+SOUND_THRESHOLD)
+    cp      a, h
+    sbc     a, a
+    cpl
+    and     a, b
+    rlca
+    sbc     a, a
+    and     a, #SOUND_MASK
+    out     (#SOUND_PORT), a
+
+    exx
+    inc     bc                          ; slots played
+    exx
+
+    ; 16 bit galois lfsr for the noise
+    ld      hl, (_g_sound_random)
+    add     hl, hl
+    sbc     a, a
+    and     a, #0x2d
+    xor     a, l
+    ld      l, a
+    ld      (_g_sound_random), hl
+
+    in      a, (#CRT_STATUS_PORT)
+    and     a, #VDU_VSYNC_MASK
+    cp      a, c
+    jp      nz, sound_render_done
+    jp      sound_slot0
+
+sound_render_done:
+    exx
+    push    bc
+    exx
+    pop     hl
+    ret
+
+;;; Music, two channels of pattern data played on sound channels 0 and 1
+;;;
+;;; Song data, as written by beemusic:
+;;;
+;;;     0   frames per row
+;;;     1   rows per pattern
+;;;     2   entries in the order list
+;;;     3   order list, offset of each entry's pattern from the song start
+;;;     ... patterns, each row is the note of channel 0 then channel 1
+;;;
+;;; A note is 0 to hold the last one, 1 for off or 2 up for C2 up to A6.
+;;; Each row is played with no branches, so music_frame() has a fixed cost
+;;; for each of the ways through it, and returns that cost.
+
+;;; void music_play( const uint8_t *song )
+;;;
+;;; Start a song from the top, 0 stops the music and frees its channels.
+_music_play:
+    pop     bc
+    pop     hl
+    push    hl
+    push    bc
+
+    ld      (music_song), hl
+    ld      a, #0xff
+    ld      (music_order), a            ; the first row moves on to entry 0
+    ld      a, #1
+    ld      (music_rows), a
+    ld      (music_wait), a
+    ld      (music_notes), a
+    ld      (music_notes+1), a
+
+    xor     a, a
+    ld      (MUSIC_CHANNEL0+SOUND_PATTERN), a
+    ld      (MUSIC_CHANNEL0+SOUND_PRIORITY), a
+    ld      (MUSIC_CHANNEL0+SOUND_FRAMES), a
+    ld      (MUSIC_CHANNEL1+SOUND_PATTERN), a
+    ld      (MUSIC_CHANNEL1+SOUND_PRIORITY), a
+    ld      (MUSIC_CHANNEL1+SOUND_FRAMES), a
+    ret
+
+;;; uint16_t music_frame()
+;;;
+;;; Once a frame, plays the next row when it's due. Returns the T-states it
+;;; took: MUSIC_IDLE_T between rows, MUSIC_ROW_T on a row and
+;;; MUSIC_PATTERN_T more at the start of a pattern.
+_music_frame:
+    ld      hl, #music_wait
+    dec     (hl)
+    jr      z, 00001$
+    ld      hl, #MUSIC_IDLE_T
+    ret
+
+00001$:
+    inc     (hl)                        ; stopped looks again next frame
+    ld      a, (music_song+1)           ; songs aren't in page 0
+    or      a, a
+    jr      nz, 00002$
+    ld      hl, #MUSIC_STOPPED_T
+    ret
+
+00002$:
+    ld      hl, #MUSIC_ROW_T
+    ld      (music_t), hl
+    ld      hl, (music_song)
+    ld      a, (hl)
+    ld      (music_wait), a             ; frames to the next row
+    ld      hl, #music_rows
+    dec     (hl)
+    call    z, music_pattern
+
+    ld      hl, (music_row)
+
+    ; channel 0, 0 holds the last note
+    ld      a, (hl)
+    inc     hl
+    push    hl
+    ld      c, a
+    cp      a, #1
+    sbc     a, a                        ; 0xff on hold
+    ld      b, a
+    ld      a, (music_notes+0)
+    xor     a, c
+    and     a, b
+    xor     a, c
+    ld      (music_notes+0), a
+
+    ; 1 is off, the rest gate the speaker
+    ld      c, a
+    cp      a, #2
+    sbc     a, a
+    cpl
+    and     a, #0x80
+    ld      b, a
+    ld      l, c
+    ld      h, #0
+    add     hl, hl
+    ld      de, #music_steps
+    add     hl, de
+    ld      e, (hl)
+    inc     hl
+    ld      d, (hl)
+
+    ; an effect at or above the music keeps the channel until it ends,
+    ; the row goes to music_spare instead
+    ld      a, (MUSIC_CHANNEL0+SOUND_FRAMES)
+    add     a, #1                       ; carry on hold, the music has it
+    sbc     a, a
+    ld      c, a
+    ld      a, (MUSIC_CHANNEL0+SOUND_PRIORITY)
+    sub     a, #MUSIC_PRIORITY          ; carry below the music
+    sbc     a, a
+    or      a, c
+    and     a, #2
+    ld      hl, #music_channel0
+    add     a, l
+    ld      l, a
+    adc     a, h
+    sub     a, l
+    ld      h, a
+    ld      a, (hl)
+    inc     hl
+    ld      h, (hl)
+    ld      l, a
+
+    ; take the channel back from any effect below the music
+    ld      (hl), e                     ; step
+    inc     hl
+    ld      (hl), d
+    inc     hl
+    ld      (hl), #0x7f                 ; threshold
+    inc     hl
+    ld      (hl), b                     ; pattern
+    inc     hl
+    ld      (hl), #0                    ; noise
+    inc     hl
+    ld      (hl), #MUSIC_PRIORITY
+    inc     hl
+    ld      (hl), #SOUND_HOLD           ; frames
+    inc     hl
+    ld      (hl), #0                    ; sweep
+    inc     hl
+    ld      (hl), #0
+    pop     hl
+
+    ; channel 1, 0 holds the last note
+    ld      a, (hl)
+    inc     hl
+    push    hl
+    ld      c, a
+    cp      a, #1
+    sbc     a, a                        ; 0xff on hold
+    ld      b, a
+    ld      a, (music_notes+1)
+    xor     a, c
+    and     a, b
+    xor     a, c
+    ld      (music_notes+1), a
+
+    ; 1 is off, the rest gate the speaker
+    ld      c, a
+    cp      a, #2
+    sbc     a, a
+    cpl
+    and     a, #0x80
+    ld      b, a
+    ld      l, c
+    ld      h, #0
+    add     hl, hl
+    ld      de, #music_steps
+    add     hl, de
+    ld      e, (hl)
+    inc     hl
+    ld      d, (hl)
+
+    ; an effect at or above the music keeps the channel until it ends,
+    ; the row goes to music_spare instead
+    ld      a, (MUSIC_CHANNEL1+SOUND_FRAMES)
+    add     a, #1                       ; carry on hold, the music has it
+    sbc     a, a
+    ld      c, a
+    ld      a, (MUSIC_CHANNEL1+SOUND_PRIORITY)
+    sub     a, #MUSIC_PRIORITY          ; carry below the music
+    sbc     a, a
+    or      a, c
+    and     a, #2
+    ld      hl, #music_channel1
+    add     a, l
+    ld      l, a
+    adc     a, h
+    sub     a, l
+    ld      h, a
+    ld      a, (hl)
+    inc     hl
+    ld      h, (hl)
+    ld      l, a
+
+    ; take the channel back from any effect below the music
+    ld      (hl), e                     ; step
+    inc     hl
+    ld      (hl), d
+    inc     hl
+    ld      (hl), #0x7f                 ; threshold
+    inc     hl
+    ld      (hl), b                     ; pattern
+    inc     hl
+    ld      (hl), #0                    ; noise
+    inc     hl
+    ld      (hl), #MUSIC_PRIORITY
+    inc     hl
+    ld      (hl), #SOUND_HOLD           ; frames
+    inc     hl
+    ld      (hl), #0                    ; sweep
+    inc     hl
+    ld      (hl), #0
+    pop     hl
+
+    ld      (music_row), hl
+    ld      hl, (music_t)
+    ret
+
+;;; Move on to the next entry of the order list, back to the first after the last
+music_pattern:
+    ld      hl, (music_song)
+    inc     hl
+    ld      a, (hl)
+    ld      (music_rows), a             ; rows per pattern
+    inc     hl
+    ld      a, (music_order)
+    inc     a
+    ld      b, a
+    cp      a, (hl)                     ; carry while before the end
+    sbc     a, a
+    and     a, b
+    ld      (music_order), a
+    inc     hl
+    ld      e, a
+    ld      d, #0
+    add     hl, de
+    add     hl, de
+    ld      e, (hl)
+    inc     hl
+    ld      d, (hl)
+    ld      hl, (music_song)
+    add     hl, de
+    ld      (music_row), hl
+    ld      hl, #MUSIC_ROW_T+MUSIC_PATTERN_T
+    ld      (music_t), hl
+    ret
+
+;;; Where the rows of each channel go, from SOUND_STEP: the spare when an
+;;; effect has the channel, otherwise the channel
+music_channel0:
+    .dw     music_spare+SOUND_STEP, MUSIC_CHANNEL0+SOUND_STEP
+music_channel1:
+    .dw     music_spare+SOUND_STEP, MUSIC_CHANNEL1+SOUND_STEP
+
+;;; Phase step of each note, f * 65536 / 3516 Hz, the rate of a channel
+music_steps:
+    .dw     0, 0                        ; hold (never looked up) and off
+    .dw     1219, 1292, 1369, 1450, 1536, 1628, 1724, 1827, 1935, 2051, 2172, 2302   ; C2-B2
+    .dw     2439, 2584, 2737, 2900, 3072, 3255, 3449, 3654, 3871, 4101, 4345, 4603   ; C3-B3
+    .dw     4877, 5167, 5474, 5800, 6145, 6510, 6897, 7307, 7742, 8202, 8690, 9207   ; C4-B4
+    .dw     9754, 10334, 10949, 11600, 12289, 13020, 13794, 14615, 15484, 16404, 17380, 18413   ; C5-B5
+    .dw     19508, 20668, 21897, 23199, 24579, 26040, 27589, 29229, 30967, 32809   ; C6-A6
@@ -0,0 +1,350 @@
+;;; \file sprite_bee.s
+;;;
+;;; \brief Software sprites composed on pcg glyphs
+;;;
+;;; \copyright Copyright 2022 UnderM4hz
+;;; Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+;;; to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+;;; and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+;;; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;;; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+;;; WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;;;
+;;; Feel free to give credit
+;;;
+;;; A sprite is 8x16 pixels and covers up to four tiles, two columns of two
+;;; rows. Its four pcg glyphs are in column order: top left, bottom left,
+;;; top right, bottom right, so each column is 32 bytes of pcg ram with the
+;;; sprite's 16 rows somewhere in it.
+;;;
+;;; sprite_compose() copies the glyphs of the tiles under the sprite to its
+;;; own four, then draws the sprite over them from a pre-shifted image made
+;;; by pack/beesprite. Each row of the image is a keep byte and a set byte,
+;;; read with pop.
+;;;
+;;; sprite_compose_code() draws with a routine compiled by beesprite -c
+;;; instead, which stores the sprite's bytes as immediates and skips the
+;;; transparent ones. A sprite's glyphs are 64 byte aligned, so the
+;;; routines only step l.
+;;;
+;;; Called from C as __sdcccall(0), see vram_bee.s.
+
+    .module sprite
+    .globl  _sprite_compose
+    .globl  _sprite_compose_code
+
+GLYPH_SIZE = 16
+SPRITE_GLYPHS = 4
+
+    .area   _DATA
+
+sprite_sp:
+    .ds     2                           ; stack pointer while sp reads the image
+
+    .area   _CODE
+
+;;; void sprite_compose( uint8_t *dest, const uint8_t **backgrounds, const uint8_t *image, uint16_t row )
+;;;
+;;; Compose a sprite on the four glyphs at dest, in pcg ram with the pcg
+;;; switched in. backgrounds points to the four glyphs under it in the same
+;;; order, image to one shift of a beesprite image and row is the sprite's
+;;; first pixel row in the top tiles, 0-15. Interrupts are held off while
+;;; sp reads the image and restored after.
+;;;
+;;; 2945 T-states, 1350 copying the backgrounds and 1216 drawing.
+_sprite_compose:
+    call    sprite_backgrounds
+
+    ld      a, i                        ; p/v = interrupts enabled
+    jp      pe, 00001$
+    ld      a, i                        ; nmos p/v is 0 if the first took an interrupt
+00001$:
+    push    af
+    di
+    ld      (sprite_sp), sp
+    ex      de, hl
+    ld      sp, hl
+    ex      de, hl
+
+    ; left column, 38 T-states a row
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+
+    ; right column, a column of two glyphs on
+    ld      de, #GLYPH_SIZE
+    add     hl, de
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+    pop     bc
+    ld      a, (hl)
+    and     a, c
+    or      a, b
+    ld      (hl), a
+    inc     hl
+
+    ld      sp, (sprite_sp)
+    pop     af
+    ret     po
+    ei
+    ret
+
+;;; void sprite_compose_code( uint8_t *dest, const uint8_t **backgrounds, const void *code, uint16_t row )
+;;;
+;;; sprite_compose() with a routine from beesprite -c for the shift, from
+;;; its table of 8 for each image. dest has to be 64 byte aligned, as the
+;;; sprite tiles are. Interrupts are left alone.
+;;;
+;;; 1610 T-states plus the routine: 10 a row of set and clear pixels, 28 a
+;;; row mixed with the background and 4 a transparent row.
+_sprite_compose_code:
+    call    sprite_backgrounds
+    push    de
+    ret                                 ; to the routine, with hl at the first row
+
+;;; Copy the backgrounds for sprite_compose() or sprite_compose_code(),
+;;; whose arguments are above both return addresses. Returns hl = the
+;;; sprite's first row and de = the image or code.
+sprite_backgrounds:
+    ld      hl, #4
+    add     hl, sp
+    ld      e, (hl)
+    inc     hl
+    ld      d, (hl)                     ; de = dest
+    inc     hl
+    ld      c, (hl)
+    inc     hl
+    ld      b, (hl)                     ; bc = backgrounds
+    inc     hl
+    push    bc
+    ld      c, (hl)
+    inc     hl
+    ld      b, (hl)                     ; bc = image
+    inc     hl
+    ld      a, (hl)                     ; a = row
+    pop     hl
+    push    bc
+
+    call    sprite_glyph_copy
+    call    sprite_glyph_copy
+    call    sprite_glyph_copy
+    call    sprite_glyph_copy
+
+    ; de is past the glyphs, back to the sprite's first row
+    ex      de, hl
+    ld      bc, #-GLYPH_SIZE * SPRITE_GLYPHS
+    add     hl, bc
+    ld      c, a
+    ld      b, #0
+    add     hl, bc
+    pop     de                          ; de = image or code
+    ret
+
+;;; Copy the glyph at the pointer at hl to de, moving both on
+sprite_glyph_copy:
+    ld      c, (hl)
+    inc     hl
+    ld      b, (hl)
+    inc     hl
+    push    hl
+    ld      h, b
+    ld      l, c
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    pop     hl
+    ret
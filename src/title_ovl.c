@@ -0,0 +1,33 @@
+// Copyright 2022 UnderM4hz
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// Feel free to give credit
+
+// Title screen overlay, loaded by overlay_load( "TITLE   OVL" )
+//
+// Built with its code and constants in _OVERLAY, which the Makefile links at
+// OVERLAY_ADDRESS against the resident program and writes to title.ovl. The
+// first function is the entry. It can call anything resident, but has no
+// variables of its own, they would move the resident ones.
+
+#include <stdint.h>
+
+#define VDU_COLUMNS 64
+#define TITLE_ROW 14                    // Blank row in the title box, src/assets/title.txt
+#define TITLE_COLUMN 4
+
+///< Resident, in microbee.c
+void vdu_tiles_set( uint16_t offset, const uint8_t *tiles, uint16_t length );
+
+///< Entry, at OVERLAY_ADDRESS
+void title_overlay() {
+
+    static const char line[] = "This line is from an overlay read through the bdos";
+
+    vdu_tiles_set( TITLE_ROW * VDU_COLUMNS + TITLE_COLUMN, (const uint8_t*)line, sizeof( line ) - 1 );
+}
@@ -0,0 +1,324 @@
+;;; \file vram_bee.s
+;;;
+;;; \brief Fast fill and copy for video ram
+;;;
+;;; \copyright Copyright 2022 UnderM4hz
+;;; Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+;;; to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+;;; and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so.
+;;; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;;; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+;;; WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;;;
+;;; Feel free to give credit
+;;;
+;;; Called from C as __sdcccall(0): all arguments are words on the stack,
+;;; left to right above the return address, and the caller removes them.
+;;; Byte values are passed as words.
+;;;
+;;; T-state costs include the call from C.
+
+    .module vram
+    .globl  _vram_fill
+    .globl  _vram_fill_rows
+    .globl  _vram_fill_column
+    .globl  _vram_copy
+
+VDU_COLUMNS = 64                        ; bytes from one tile row to the next
+
+    .area   _DATA
+
+vram_sp:
+    .ds     2                           ; stack pointer while sp is the fill pointer
+
+    .area   _CODE
+
+;;; void vram_fill( uint8_t *dest, uint16_t length, uint16_t value )
+;;;
+;;; Fill with push, 11 T-states for 2 bytes. Interrupts are held off while
+;;; sp points at the fill and restored after.
+;;;
+;;; 5.9 T-states a byte plus 420 set up, a 64x16 page (1024 bytes) is 6500.
+_vram_fill:
+    ld      hl, #2
+    add     hl, sp
+    ld      e, (hl)
+    inc     hl
+    ld      d, (hl)                     ; de = dest
+    inc     hl
+    ld      c, (hl)
+    inc     hl
+    ld      b, (hl)                     ; bc = length
+    inc     hl
+    ld      a, (hl)                     ; a = value
+
+    ld      h, a
+    ld      a, b
+    or      a, c
+    ret     z
+    ld      a, h
+
+    ; an odd length does the first byte on its own
+    bit     0, c
+    jr      z, 00001$
+    ld      (de), a
+    inc     de
+    dec     bc
+00001$:
+    ld      h, a
+    ld      l, a
+    ex      de, hl                      ; hl = dest, de = value in both bytes
+    add     hl, bc                      ; hl = end, push works down from it
+    srl     b
+    rr      c                           ; bc = words
+    ld      a, b
+    or      a, c
+    ret     z
+
+vram_fill_words:
+    ; hl = end, bc = words, de = value
+    ld      a, i                        ; p/v = interrupts enabled
+    jp      pe, 00001$
+    ld      a, i                        ; nmos p/v is 0 if the first took an interrupt
+00001$:
+    push    af
+    di
+    ld      (vram_sp), sp
+    ld      sp, hl
+
+    ; passes of the block = ( words + 15 ) / 16
+    ld      hl, #15
+    add     hl, bc
+    ld      a, l
+    srl     h
+    rra
+    srl     h
+    rra
+    srl     h
+    rra
+    srl     h
+    rra
+    ld      b, a
+
+    ; the first pass skips ( 16 - words % 16 ) % 16 pushes
+    ld      a, c
+    neg
+    and     a, #0x0f
+    ld      hl, #vram_fill_block
+    add     a, l
+    ld      l, a
+    adc     a, h
+    sub     a, l
+    ld      h, a
+    jp      (hl)
+
+vram_fill_block:
+    push    de
+    push    de
+    push    de
+    push    de
+    push    de
+    push    de
+    push    de
+    push    de
+    push    de
+    push    de
+    push    de
+    push    de
+    push    de
+    push    de
+    push    de
+    push    de
+    djnz    vram_fill_block
+
+    ld      sp, (vram_sp)
+    pop     af
+    jp      po, 00002$
+    ei
+00002$:
+    ret
+
+;;; void vram_fill_rows( uint8_t *dest, uint16_t rows, uint16_t value )
+;;;
+;;; Fill whole tile rows from dest, as vram_fill() without the odd byte
+;;; and partial block handling.
+;;;
+;;; 380 T-states a row plus 440 set up, all 16 rows is 6500.
+_vram_fill_rows:
+    ld      hl, #2
+    add     hl, sp
+    ld      e, (hl)
+    inc     hl
+    ld      d, (hl)                     ; de = dest
+    inc     hl
+    ld      b, (hl)                     ; b = rows
+    inc     hl
+    inc     hl
+    ld      a, (hl)                     ; a = value
+
+    inc     b
+    dec     b
+    ret     z
+
+    ; words = rows * VDU_COLUMNS / 2, end = dest + rows * VDU_COLUMNS
+    ld      h, #0
+    ld      l, b
+    add     hl, hl
+    add     hl, hl
+    add     hl, hl
+    add     hl, hl
+    add     hl, hl
+    ld      c, l
+    ld      b, h                        ; bc = words
+    add     hl, hl
+    add     hl, de                      ; hl = end
+    ld      d, a
+    ld      e, a
+    jr      vram_fill_words
+
+;;; void vram_fill_column( uint8_t *dest, uint16_t rows, uint16_t value )
+;;;
+;;; Fill a column of tiles from dest down, unrolled ld (hl) / add hl.
+;;;
+;;; 18 T-states a row plus 250 set up, all 16 rows is 540.
+_vram_fill_column:
+    ld      hl, #2
+    add     hl, sp
+    ld      e, (hl)
+    inc     hl
+    ld      d, (hl)                     ; de = dest
+    inc     hl
+    ld      b, (hl)                     ; b = rows
+    inc     hl
+    inc     hl
+    ld      c, (hl)                     ; c = value
+
+    ld      a, b
+    or      a, a
+    ret     z
+
+    ; the first pass skips ( 16 - rows % 16 ) % 16 rows of the block
+    neg
+    and     a, #0x0f
+    add     a, a                        ; each row is 2 bytes
+    ld      hl, #vram_column_block
+    add     a, l
+    ld      l, a
+    adc     a, h
+    sub     a, l
+    ld      h, a
+    push    hl
+
+    ; passes of the block = ( rows + 15 ) / 16
+    ld      a, b
+    add     a, #15
+    rra
+    rrca
+    rrca
+    rrca
+    and     a, #0x1f
+    ld      b, a
+
+    ex      de, hl                      ; hl = dest
+    ld      de, #VDU_COLUMNS
+    ld      a, c
+    ret                                 ; into the block
+
+vram_column_block:
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    ld      (hl), a
+    add     hl, de
+    djnz    vram_column_block
+    ret
+
+;;; void vram_copy( uint8_t *dest, const uint8_t *src, uint16_t length )
+;;;
+;;; Copy with unrolled ldi, 16 T-states a byte against 21 for ldir.
+;;;
+;;; 16.6 T-states a byte plus 250 set up, a 64x16 page (1024 bytes) is 17250.
+_vram_copy:
+    ld      hl, #2
+    add     hl, sp
+    ld      e, (hl)
+    inc     hl
+    ld      d, (hl)                     ; de = dest
+    inc     hl
+    ld      c, (hl)
+    inc     hl
+    ld      b, (hl)
+    inc     hl
+    push    bc                          ; src
+    ld      c, (hl)
+    inc     hl
+    ld      b, (hl)                     ; bc = length
+
+    ld      a, b
+    or      a, c
+    jr      z, 00001$
+
+    ; the first pass skips ( 16 - length % 16 ) % 16 ldi
+    ld      a, c
+    neg
+    and     a, #0x0f
+    add     a, a                        ; each ldi is 2 bytes
+    ld      hl, #vram_copy_block
+    add     a, l
+    ld      l, a
+    adc     a, h
+    sub     a, l
+    ld      h, a
+    ex      (sp), hl                    ; hl = src
+    ret                                 ; into the block
+
+00001$:
+    pop     hl
+    ret
+
+vram_copy_block:
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    ldi
+    jp      pe, vram_copy_block         ; p/v is set while bc is not 0
+    ret